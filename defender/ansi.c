@@ -0,0 +1,286 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "ansi.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define ANSI_INITIAL_CAPACITY 16384
+
+static int digits(int value) {
+    int count = 1;
+
+    while (value >= 10) {
+        value /= 10;
+        count++;
+    }
+    return count;
+}
+
+static void put_bytes(AnsiEncoder *enc, const char *bytes, size_t length) {
+    if (enc->failed) return;
+    if (enc->size + length > enc->capacity) {
+        size_t capacity = enc->capacity ? enc->capacity : ANSI_INITIAL_CAPACITY;
+        char *data;
+
+        while (capacity < enc->size + length) capacity *= 2;
+        data = realloc(enc->data, capacity);
+        if (!data) {
+            enc->failed = 1;
+            return;
+        }
+        enc->data = data;
+        enc->capacity = capacity;
+    }
+    memcpy(enc->data + enc->size, bytes, length);
+    enc->size += length;
+}
+
+static void put_format(AnsiEncoder *enc, const char *format, int a, int b) {
+    char text[32];
+    int length = snprintf(text, sizeof(text), format, a, b);
+
+    put_bytes(enc, text, (size_t)length);
+}
+
+/* CSI n <final>, with n left out when it is 1. */
+static int csi_count_cost(int n) {
+    return 3 + (n > 1 ? digits(n) : 0);
+}
+
+static void put_csi_count(AnsiEncoder *enc, int n, char final) {
+    if (n > 1) put_format(enc, "\x1b[%d%c", n, final);
+    else put_format(enc, "\x1b[%c", final, 0);
+}
+
+static int cup_cost(int x, int y) {
+    if (x == 0 && y == 0) return 3;
+    if (x == 0) return 3 + digits(y + 1);
+    return 4 + digits(y + 1) + digits(x + 1);
+}
+
+static int horizontal_cost(int from_x, int to_x) {
+    int back;
+
+    if (to_x == from_x) return 0;
+    if (to_x > from_x) return csi_count_cost(to_x - from_x);
+    back = csi_count_cost(from_x - to_x);
+    /* CR, then forward from column 0. */
+    return to_x == 0 ? 1 : (back < 1 + csi_count_cost(to_x) ? back : 1 + csi_count_cost(to_x));
+}
+
+static int relative_cost(const AnsiEncoder *enc, int x, int y) {
+    int dy = y - enc->cursor_y;
+    int vertical = dy == 0 ? 0 : csi_count_cost(dy > 0 ? dy : -dy);
+
+    return vertical + horizontal_cost(enc->cursor_x, x);
+}
+
+int ansi_move_cost(const AnsiEncoder *enc, int x, int y) {
+    int relative;
+
+    if (enc->cursor_x < 0) return cup_cost(x, y);
+    if (enc->cursor_x == x && enc->cursor_y == y) return 0;
+    relative = relative_cost(enc, x, y);
+    return relative < cup_cost(x, y) ? relative : cup_cost(x, y);
+}
+
+void ansi_move(AnsiEncoder *enc, int x, int y) {
+    if (enc->cursor_x == x && enc->cursor_y == y) return;
+
+    if (enc->cursor_x < 0 || cup_cost(x, y) <= relative_cost(enc, x, y)) {
+        if (x == 0 && y == 0) put_bytes(enc, "\x1b[H", 3);
+        else if (x == 0) put_format(enc, "\x1b[%dH", y + 1, 0);
+        else put_format(enc, "\x1b[%d;%dH", y + 1, x + 1);
+    } else {
+        int dy = y - enc->cursor_y;
+
+        if (dy < 0) put_csi_count(enc, -dy, 'A');
+        else if (dy > 0) put_csi_count(enc, dy, 'B');
+
+        if (x > enc->cursor_x) {
+            put_csi_count(enc, x - enc->cursor_x, 'C');
+        } else if (x < enc->cursor_x) {
+            if (x == 0 || 1 + csi_count_cost(x) < csi_count_cost(enc->cursor_x - x)) {
+                put_bytes(enc, "\r", 1);
+                if (x > 0) put_csi_count(enc, x, 'C');
+            } else {
+                put_csi_count(enc, enc->cursor_x - x, 'D');
+            }
+        }
+    }
+    enc->cursor_x = x;
+    enc->cursor_y = y;
+}
+
+static int color_param(char *out, int color, int background) {
+    if (color < 0) return sprintf(out, background ? "49" : "39");
+    if (color < 8) return sprintf(out, "%d", (background ? 40 : 30) + color);
+    if (color < 16) return sprintf(out, "%d", (background ? 100 : 90) + color - 8);
+    return sprintf(out, background ? "48;5;%d" : "38;5;%d", color);
+}
+
+/* Writes the parameters of the shortest SGR that takes the terminal to (fg, bg): either the
+ * components that changed, or a reset followed by the non-default ones. */
+static int sgr_params(const AnsiEncoder *enc, int fg, int bg, char *out) {
+    char incremental[32];
+    char reset[32];
+    int inc_length = 0;
+    int reset_length = 0;
+
+    if (enc->sgr_known) {
+        if (fg != enc->fg) inc_length += color_param(incremental + inc_length, fg, 0);
+        if (bg != enc->bg) {
+            if (inc_length) incremental[inc_length++] = ';';
+            inc_length += color_param(incremental + inc_length, bg, 1);
+        }
+    }
+
+    if (fg >= 0) reset_length += color_param(reset + reset_length, fg, 0);
+    if (bg >= 0) {
+        if (reset_length) reset[reset_length++] = ';';
+        reset_length += color_param(reset + reset_length, bg, 1);
+    }
+    /* "\x1b[m" resets; "\x1b[0;...m" resets then sets. */
+    if (reset_length) {
+        memmove(reset + 2, reset, (size_t)reset_length);
+        reset[0] = '0';
+        reset[1] = ';';
+        reset_length += 2;
+    }
+
+    if (enc->sgr_known && inc_length <= reset_length) {
+        memcpy(out, incremental, (size_t)inc_length);
+        return inc_length;
+    }
+    memcpy(out, reset, (size_t)reset_length);
+    return reset_length;
+}
+
+static void set_colors(AnsiEncoder *enc, int fg, int bg) {
+    char params[64];
+    int length;
+
+    if (enc->sgr_known && enc->fg == fg && enc->bg == bg) return;
+
+    length = sgr_params(enc, fg, bg, params);
+    put_bytes(enc, "\x1b[", 2);
+    put_bytes(enc, params, (size_t)length);
+    put_bytes(enc, "m", 1);
+    enc->sgr_known = 1;
+    enc->fg = fg;
+    enc->bg = bg;
+}
+
+int ansi_pair_is_current(const AnsiEncoder *enc, int pair) {
+    return enc->sgr_known && enc->fg == enc->pair_fg[pair] && enc->bg == enc->pair_bg[pair];
+}
+
+void ansi_use_pair(AnsiEncoder *enc, int pair) {
+    set_colors(enc, enc->pair_fg[pair], enc->pair_bg[pair]);
+}
+
+static void advance(AnsiEncoder *enc, int count) {
+    enc->cursor_x += count;
+    /* Terminals differ on where the cursor sits after filling the last column. */
+    if (enc->cursor_x >= enc->width) enc->cursor_x = enc->cursor_y = -1;
+}
+
+void ansi_text(AnsiEncoder *enc, const char *text, int length) {
+    put_bytes(enc, text, (size_t)length);
+    advance(enc, length);
+}
+
+void ansi_repeat(AnsiEncoder *enc, char ch, int count) {
+    int rep_cost = enc->has_rep && count > 1 ? 1 + csi_count_cost(count - 1) : count;
+    int ech_cost = count + 1;
+
+    /* ECH blanks in the current background without moving; the cursor is then moved past
+     * the run, which costs at least a CUF. */
+    if (ch == ' ' && enc->has_ech && (enc->has_bce || enc->bg < 0)) {
+        ech_cost = csi_count_cost(count) + csi_count_cost(count);
+    }
+
+    if (ech_cost < count && ech_cost < rep_cost) {
+        put_csi_count(enc, count, 'X');
+        if (enc->cursor_x + count < enc->width) put_csi_count(enc, count, 'C');
+        advance(enc, count);
+    } else if (rep_cost < count) {
+        put_bytes(enc, &ch, 1);
+        put_csi_count(enc, count - 1, 'b');
+        advance(enc, count);
+    } else {
+        int i;
+
+        for (i = 0; i < count; ++i) put_bytes(enc, &ch, 1);
+        advance(enc, count);
+    }
+}
+
+void ansi_init(AnsiEncoder *enc, int has_rep, int has_ech, int has_bce) {
+    int pair;
+
+    memset(enc, 0, sizeof(*enc));
+    for (pair = 0; pair < ANSI_MAX_PAIRS; ++pair) {
+        enc->pair_fg[pair] = -1;
+        enc->pair_bg[pair] = -1;
+    }
+    enc->has_rep = has_rep;
+    enc->has_ech = has_ech;
+    enc->has_bce = has_bce;
+    ansi_invalidate(enc);
+}
+
+void ansi_free(AnsiEncoder *enc) {
+    free(enc->data);
+    memset(enc, 0, sizeof(*enc));
+}
+
+void ansi_set_pair(AnsiEncoder *enc, int pair, int fg, int bg) {
+    if (pair < 0 || pair >= ANSI_MAX_PAIRS) return;
+    enc->pair_fg[pair] = (short)fg;
+    enc->pair_bg[pair] = (short)bg;
+}
+
+void ansi_set_size(AnsiEncoder *enc, int width, int height) {
+    enc->width = width;
+    enc->height = height;
+}
+
+void ansi_invalidate(AnsiEncoder *enc) {
+    enc->cursor_x = -1;
+    enc->cursor_y = -1;
+    enc->sgr_known = 0;
+}
+
+void ansi_clear_screen(AnsiEncoder *enc) {
+    put_bytes(enc, "\x1b[m\x1b[H\x1b[2J", 10);
+    enc->sgr_known = 1;
+    enc->fg = -1;
+    enc->bg = -1;
+    enc->cursor_x = 0;
+    enc->cursor_y = 0;
+}
+
+int ansi_flush(AnsiEncoder *enc, int fd) {
+    size_t offset = 0;
+    int ok = !enc->failed;
+
+    if (enc->size > 0) set_colors(enc, -1, -1);
+    while (ok && offset < enc->size) {
+        ssize_t written = write(fd, enc->data + offset, enc->size - offset);
+
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            ok = 0;
+            break;
+        }
+        offset += (size_t)written;
+    }
+    enc->size = 0;
+    enc->failed = 0;
+    return ok;
+}
@@ -0,0 +1,53 @@
+#ifndef ANSI_H
+#define ANSI_H
+
+#include <stddef.h>
+
+#define ANSI_MAX_PAIRS 256
+
+/* Builds a frame of escape sequences in memory while tracking the terminal's cursor and
+ * colors, so every move, color change and repeated run is encoded in the fewest bytes
+ * the terminal's capabilities allow. ansi_flush() sends the frame with one write(). */
+typedef struct {
+    char *data;
+    size_t size;
+    size_t capacity;
+    int failed;
+    int width;
+    int height;
+    /* -1 when unknown (start of output, after a write into the last column). */
+    int cursor_x;
+    int cursor_y;
+    int sgr_known;
+    int fg;
+    int bg;
+    short pair_fg[ANSI_MAX_PAIRS];
+    short pair_bg[ANSI_MAX_PAIRS];
+    int has_rep;
+    int has_ech;
+    int has_bce;
+} AnsiEncoder;
+
+/* has_rep/has_ech/has_bce come from terminfo (rep, ech, bce). */
+void ansi_init(AnsiEncoder *enc, int has_rep, int has_ech, int has_bce);
+void ansi_free(AnsiEncoder *enc);
+/* Colors are curses color numbers; -1 is the terminal default. */
+void ansi_set_pair(AnsiEncoder *enc, int pair, int fg, int bg);
+void ansi_set_size(AnsiEncoder *enc, int width, int height);
+/* Forgets what the terminal shows, e.g. after something else wrote to it. */
+void ansi_invalidate(AnsiEncoder *enc);
+/* Resets colors and blanks the screen. */
+void ansi_clear_screen(AnsiEncoder *enc);
+
+int ansi_move_cost(const AnsiEncoder *enc, int x, int y);
+void ansi_move(AnsiEncoder *enc, int x, int y);
+/* Nonzero if pair draws in the colors currently set on the terminal. */
+int ansi_pair_is_current(const AnsiEncoder *enc, int pair);
+void ansi_use_pair(AnsiEncoder *enc, int pair);
+/* Writes text / count copies of ch at the cursor in the current colors. */
+void ansi_text(AnsiEncoder *enc, const char *text, int length);
+void ansi_repeat(AnsiEncoder *enc, char ch, int count);
+/* Resets colors so the terminal is left in a known state, then writes the frame. */
+int ansi_flush(AnsiEncoder *enc, int fd);
+
+#endif
@@ -0,0 +1,227 @@
+#define _POSIX_C_SOURCE 199309L
+
+#include "batch.h"
+#include "bot.h"
+#include "game.h"
+#include "monotonic.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SIM_DT (1.0 / 60.0)
+/* Waves past this are counted together in the histogram. */
+#define BALANCE_MAX_WAVE 64
+
+typedef struct {
+    int games;
+    long max_steps;
+    unsigned seed;
+    int threads;
+    const char *csv_path;
+    GameLimits limits;
+} BalanceOptions;
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+            "usage: %s [--games N] [--minutes M] [--seed S] [--threads N]\n"
+            "          [--stress SCALE] [--csv FILE]\n",
+            argv0);
+}
+
+static int parse_options(int argc, char **argv, BalanceOptions *options) {
+    int i;
+
+    memset(options, 0, sizeof(*options));
+    options->games = 2000;
+    options->max_steps = (long)(10 * 60 / SIM_DT);
+    options->seed = 1;
+    game_default_limits(&options->limits);
+
+    for (i = 1; i < argc; ++i) {
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+
+        if (strcmp(argv[i], "--games") == 0 && value) {
+            options->games = atoi(value);
+            if (options->games < 1) return 0;
+            ++i;
+        } else if (strcmp(argv[i], "--minutes") == 0 && value) {
+            options->max_steps = (long)(strtod(value, NULL) * 60 / SIM_DT);
+            if (options->max_steps < 1) return 0;
+            ++i;
+        } else if (strcmp(argv[i], "--seed") == 0 && value) {
+            options->seed = (unsigned)strtoul(value, NULL, 10);
+            ++i;
+        } else if (strcmp(argv[i], "--threads") == 0 && value) {
+            options->threads = atoi(value);
+            ++i;
+        } else if (strcmp(argv[i], "--stress") == 0 && value) {
+            int scale = atoi(value);
+
+            if (scale < 1) return 0;
+            game_stress_limits(&options->limits, scale);
+            ++i;
+        } else if (strcmp(argv[i], "--csv") == 0 && value) {
+            options->csv_path = value;
+            ++i;
+        } else {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void bot_policy(const GameState *game, int index, long step, InputState *input, void *user) {
+    (void)index;
+    (void)step;
+    (void)user;
+    bot_input(game, input);
+}
+
+static int compare_ints(const void *a, const void *b) {
+    int x = *(const int *)a;
+    int y = *(const int *)b;
+
+    return (x > y) - (x < y);
+}
+
+/* values must be sorted. */
+static int percentile(const int *values, int count, double p) {
+    int index = (int)(p * (count - 1) + 0.5);
+
+    return values[index];
+}
+
+static void destroy_games(GameState *games, int count) {
+    int i;
+
+    for (i = 0; i < count; ++i) game_destroy(&games[i]);
+    free(games);
+}
+
+static int write_csv(const BalanceOptions *options, const GameState *games) {
+    FILE *file = fopen(options->csv_path, "w");
+    int i;
+
+    if (!file) return 0;
+    fprintf(file, "game,seed,steps,wave,score,humans_left,outcome,lives_lost_shot,lives_lost_collision,"
+                  "lives_lost_crash\n");
+    for (i = 0; i < options->games; ++i) {
+        const GameState *game = &games[i];
+
+        fprintf(file, "%d,%llu,%u,%d,%d,%d,%s,%d,%d,%d\n", i, (unsigned long long)game->seed, game->ai_tick,
+                game->wave_number, game->player.score, game_active_human_count(game),
+                game->game_over ? game_loss_name(game->loss_cause) : "survived",
+                game->lives_lost[GAME_LOSS_SHOT], game->lives_lost[GAME_LOSS_COLLISION],
+                game->lives_lost[GAME_LOSS_CRASH]);
+    }
+    return fclose(file) == 0;
+}
+
+static void print_report(const BalanceOptions *options, const GameState *games, long steps, double seconds,
+                         int threads) {
+    int wave_games[BALANCE_MAX_WAVE + 1];
+    long endings[GAME_LOSS_COUNT];
+    long lives_lost[GAME_LOSS_COUNT];
+    long lives_total = 0;
+    int *waves = malloc(sizeof(int) * (size_t)options->games);
+    int *scores = malloc(sizeof(int) * (size_t)options->games);
+    double score_sum = 0.0;
+    int count = options->games;
+    int i;
+
+    memset(wave_games, 0, sizeof(wave_games));
+    memset(endings, 0, sizeof(endings));
+    memset(lives_lost, 0, sizeof(lives_lost));
+    for (i = 0; i < count; ++i) {
+        const GameState *game = &games[i];
+        int loss;
+
+        wave_games[game->wave_number < BALANCE_MAX_WAVE ? game->wave_number : BALANCE_MAX_WAVE]++;
+        endings[game->game_over ? game->loss_cause : GAME_LOSS_NONE]++;
+        for (loss = 0; loss < GAME_LOSS_COUNT; ++loss) {
+            lives_lost[loss] += game->lives_lost[loss];
+            lives_total += game->lives_lost[loss];
+        }
+        if (waves && scores) {
+            waves[i] = game->wave_number;
+            scores[i] = game->player.score;
+        }
+        score_sum += game->player.score;
+    }
+
+    printf("%d games, up to %ld steps each, seed %u: %ld steps in %.2f s, %.0f steps/sec on %d threads "
+           "(%.0f per thread)\n",
+           count, options->max_steps, options->seed, steps, seconds, steps / seconds, threads,
+           steps / seconds / threads);
+    if (waves && scores) {
+        qsort(waves, (size_t)count, sizeof(int), compare_ints);
+        qsort(scores, (size_t)count, sizeof(int), compare_ints);
+        printf("wave reached: p10 %d, p50 %d, p90 %d, max %d\n", percentile(waves, count, 0.1),
+               percentile(waves, count, 0.5), percentile(waves, count, 0.9), waves[count - 1]);
+        printf("score: mean %.0f, p10 %d, p50 %d, p90 %d, max %d\n", score_sum / count,
+               percentile(scores, count, 0.1), percentile(scores, count, 0.5), percentile(scores, count, 0.9),
+               scores[count - 1]);
+    }
+    printf("game over: last life lost to %s %ld, %s %ld, %s %ld; all humans lost %ld; still playing %ld\n",
+           game_loss_name(GAME_LOSS_SHOT), endings[GAME_LOSS_SHOT],
+           game_loss_name(GAME_LOSS_COLLISION), endings[GAME_LOSS_COLLISION],
+           game_loss_name(GAME_LOSS_CRASH), endings[GAME_LOSS_CRASH],
+           endings[GAME_LOSS_HUMANS], endings[GAME_LOSS_NONE]);
+    printf("lives lost: %ld (%.2f per game): shot %.1f%%, collision %.1f%%, crash %.1f%%\n", lives_total,
+           (double)lives_total / count,
+           lives_total ? 100.0 * lives_lost[GAME_LOSS_SHOT] / lives_total : 0.0,
+           lives_total ? 100.0 * lives_lost[GAME_LOSS_COLLISION] / lives_total : 0.0,
+           lives_total ? 100.0 * lives_lost[GAME_LOSS_CRASH] / lives_total : 0.0);
+    printf("wave,games_ending_there,percent\n");
+    for (i = 1; i <= BALANCE_MAX_WAVE; ++i) {
+        if (wave_games[i] == 0) continue;
+        printf("%d%s,%d,%.1f\n", i, i == BALANCE_MAX_WAVE ? "+" : "", wave_games[i], 100.0 * wave_games[i] / count);
+    }
+    free(waves);
+    free(scores);
+}
+
+int main(int argc, char **argv) {
+    BalanceOptions options;
+    GameBatch *batch;
+    GameState *games;
+    double start;
+    double seconds;
+    long steps;
+    int i;
+
+    if (!parse_options(argc, argv, &options)) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    games = calloc((size_t)options.games, sizeof(GameState));
+    if (!games) return 1;
+    for (i = 0; i < options.games; ++i) {
+        if (!game_create(&games[i], &options.limits)) {
+            fprintf(stderr, "could not allocate %d games for those limits\n", options.games);
+            destroy_games(games, options.games);
+            return 1;
+        }
+    }
+    batch = game_batch_create(options.threads);
+    if (!batch) {
+        destroy_games(games, options.games);
+        return 1;
+    }
+
+    game_batch_init(games, options.games, options.seed);
+    start = monotonic_seconds();
+    steps = game_batch_run(batch, games, options.games, options.max_steps, SIM_DT, bot_policy, NULL);
+    seconds = monotonic_seconds() - start;
+
+    print_report(&options, games, steps, seconds, game_batch_thread_count(batch));
+    if (options.csv_path && !write_csv(&options, games)) {
+        fprintf(stderr, "could not write %s\n", options.csv_path);
+    }
+
+    game_batch_destroy(batch);
+    destroy_games(games, options.games);
+    return 0;
+}
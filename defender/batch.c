@@ -0,0 +1,218 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "batch.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define BATCH_CHUNK 4
+
+/* Each worker starts on its own slice and steals from the others' slices once it runs dry.
+ * Owner and thieves claim through the same counter, so a game is never stepped twice. */
+typedef struct {
+    _Alignas(64) atomic_int next;
+    int end;
+} WorkRange;
+
+struct GameBatch {
+    pthread_t *threads;
+    WorkRange *ranges;
+    int thread_count;
+    pthread_mutex_t lock;
+    pthread_cond_t start_cond;
+    pthread_cond_t done_cond;
+    unsigned generation;
+    int busy_workers;
+    int shutdown;
+    atomic_long steps_run;
+
+    GameState *games;
+    long steps;
+    double dt;
+    GameBatchPolicy policy;
+    void *user;
+};
+
+typedef struct {
+    GameBatch *batch;
+    int index;
+} WorkerArgs;
+
+static long run_game(GameBatch *batch, int index) {
+    GameState *game = &batch->games[index];
+    long step;
+
+    for (step = 0; step < batch->steps && !game->game_over; ++step) {
+        InputState input;
+
+        memset(&input, 0, sizeof(input));
+        if (batch->policy) batch->policy(game, index, step, &input, batch->user);
+        game_step(game, batch->dt, &input);
+    }
+    return step;
+}
+
+static void run_share(GameBatch *batch, int self) {
+    int k;
+
+    for (k = 0; k < batch->thread_count; ++k) {
+        WorkRange *range = &batch->ranges[(self + k) % batch->thread_count];
+        int start;
+
+        while ((start = atomic_fetch_add(&range->next, BATCH_CHUNK)) < range->end) {
+            int stop = start + BATCH_CHUNK < range->end ? start + BATCH_CHUNK : range->end;
+            long steps_run = 0;
+            int i;
+
+            for (i = start; i < stop; ++i) steps_run += run_game(batch, i);
+            atomic_fetch_add(&batch->steps_run, steps_run);
+        }
+    }
+}
+
+static void *worker_main(void *arg) {
+    WorkerArgs *args = arg;
+    GameBatch *batch = args->batch;
+    int self = args->index;
+    unsigned seen = 0;
+
+    free(args);
+    for (;;) {
+        pthread_mutex_lock(&batch->lock);
+        while (batch->generation == seen && !batch->shutdown) {
+            pthread_cond_wait(&batch->start_cond, &batch->lock);
+        }
+        if (batch->shutdown) {
+            pthread_mutex_unlock(&batch->lock);
+            return NULL;
+        }
+        seen = batch->generation;
+        pthread_mutex_unlock(&batch->lock);
+
+        run_share(batch, self);
+
+        pthread_mutex_lock(&batch->lock);
+        if (--batch->busy_workers == 0) pthread_cond_signal(&batch->done_cond);
+        pthread_mutex_unlock(&batch->lock);
+    }
+}
+
+GameBatch *game_batch_create(int threads) {
+    GameBatch *batch;
+    int i;
+
+    if (threads <= 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+
+        threads = online > 0 ? (int)online : 1;
+    }
+
+    batch = calloc(1, sizeof(*batch));
+    if (!batch) return NULL;
+
+    batch->thread_count = threads;
+    batch->ranges = aligned_alloc(64, sizeof(WorkRange) * threads);
+    batch->threads = calloc(threads, sizeof(pthread_t));
+    if (!batch->ranges || !batch->threads) {
+        free(batch->ranges);
+        free(batch->threads);
+        free(batch);
+        return NULL;
+    }
+
+    pthread_mutex_init(&batch->lock, NULL);
+    pthread_cond_init(&batch->start_cond, NULL);
+    pthread_cond_init(&batch->done_cond, NULL);
+
+    for (i = 1; i < threads; ++i) {
+        WorkerArgs *args = malloc(sizeof(*args));
+
+        if (!args) {
+            batch->thread_count = i;
+            break;
+        }
+        args->batch = batch;
+        args->index = i;
+        if (pthread_create(&batch->threads[i], NULL, worker_main, args) != 0) {
+            free(args);
+            batch->thread_count = i;
+            break;
+        }
+    }
+    return batch;
+}
+
+void game_batch_destroy(GameBatch *batch) {
+    int i;
+
+    if (!batch) return;
+
+    pthread_mutex_lock(&batch->lock);
+    batch->shutdown = 1;
+    pthread_cond_broadcast(&batch->start_cond);
+    pthread_mutex_unlock(&batch->lock);
+
+    for (i = 1; i < batch->thread_count; ++i) {
+        pthread_join(batch->threads[i], NULL);
+    }
+
+    pthread_cond_destroy(&batch->done_cond);
+    pthread_cond_destroy(&batch->start_cond);
+    pthread_mutex_destroy(&batch->lock);
+    free(batch->threads);
+    free(batch->ranges);
+    free(batch);
+}
+
+int game_batch_thread_count(const GameBatch *batch) {
+    return batch->thread_count;
+}
+
+void game_batch_init(GameState *games, int count, uint64_t base_seed) {
+    int i;
+
+    for (i = 0; i < count; ++i) {
+        game_init(&games[i], game_seed_mix(base_seed + (uint64_t)i));
+    }
+}
+
+long game_batch_run(GameBatch *batch, GameState *games, int count, long steps, double dt,
+                    GameBatchPolicy policy, void *user) {
+    int per_worker = (count + batch->thread_count - 1) / batch->thread_count;
+    int i;
+
+    for (i = 0; i < batch->thread_count; ++i) {
+        int begin = i * per_worker;
+        int end = begin + per_worker;
+
+        if (begin > count) begin = count;
+        if (end > count) end = count;
+        atomic_store(&batch->ranges[i].next, begin);
+        batch->ranges[i].end = end;
+    }
+
+    atomic_store(&batch->steps_run, 0);
+
+    pthread_mutex_lock(&batch->lock);
+    batch->games = games;
+    batch->steps = steps;
+    batch->dt = dt;
+    batch->policy = policy;
+    batch->user = user;
+    batch->busy_workers = batch->thread_count - 1;
+    batch->generation++;
+    pthread_cond_broadcast(&batch->start_cond);
+    pthread_mutex_unlock(&batch->lock);
+
+    run_share(batch, 0);
+
+    pthread_mutex_lock(&batch->lock);
+    while (batch->busy_workers > 0) {
+        pthread_cond_wait(&batch->done_cond, &batch->lock);
+    }
+    pthread_mutex_unlock(&batch->lock);
+    return atomic_load(&batch->steps_run);
+}
@@ -0,0 +1,28 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "game.h"
+
+/* Produces the input for one game at one step. It must depend only on its arguments
+ * (and per-game data reached through user), or runs stop being reproducible. */
+typedef void (*GameBatchPolicy)(const GameState *game, int index, long step, InputState *input, void *user);
+
+typedef struct GameBatch GameBatch;
+
+/* threads <= 0 uses one worker per online CPU. The calling thread is one of the workers.
+ * If a worker cannot be started the batch runs with those started so far; see
+ * game_batch_thread_count(). */
+GameBatch *game_batch_create(int threads);
+void game_batch_destroy(GameBatch *batch);
+int game_batch_thread_count(const GameBatch *batch);
+
+/* Seeds game i from game_seed_mix(base_seed + i); the games must already be created. */
+void game_batch_init(GameState *games, int count, uint64_t base_seed);
+
+/* Advances every game by up to `steps` fixed steps; games that end early stay ended.
+ * A NULL policy feeds idle input. Returns once all games are done, with the number of
+ * game_step() calls actually made. */
+long game_batch_run(GameBatch *batch, GameState *games, int count, long steps, double dt,
+                    GameBatchPolicy policy, void *user);
+
+#endif
@@ -0,0 +1,628 @@
+#define _POSIX_C_SOURCE 199309L
+
+#include "batch.h"
+#include "game.h"
+#include "kernels.h"
+#include "monotonic.h"
+#include "replay.h"
+#include "snapshot.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SIM_DT (1.0 / 60.0)
+#define MAX_BENCH_WAVES 32
+#define MAX_BENCH_THREAD_COUNTS 16
+#define SNAPSHOT_BENCH_KEYFRAME_INTERVAL 30
+/* World units; a float build rounds positions to about 1e-4 near x = 600. */
+#define DEFAULT_STATE_TOLERANCE 0.01
+
+typedef enum {
+    BENCH_INPUT_IDLE = 0,
+    BENCH_INPUT_SCRIPTED,
+    BENCH_INPUT_RANDOM
+} BenchInputMode;
+
+typedef struct {
+    long steps;
+    int waves[MAX_BENCH_WAVES];
+    int wave_count;
+    int enemies;
+    unsigned seed;
+    BenchInputMode input_mode;
+    int json;
+    int batch_games;
+    int threads[MAX_BENCH_THREAD_COUNTS];
+    int thread_count_runs;
+    const char *trace_path;
+    int snapshot_window;
+    const char *states_out;
+    const char *states_check;
+    double tolerance;
+    GameLimits limits;
+} BenchOptions;
+
+typedef struct {
+    int wave;
+    long steps;
+    long restarts;
+    double seconds;
+    double avg_enemies;
+    double avg_bullets;
+    double avg_enemy_bullets;
+    GamePhaseTimes phases;
+} BenchResult;
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+            "usage: %s [--steps N] [--waves 1,5,10] [--enemies N] [--seed S]\n"
+            "          [--input idle|scripted|random] [--format csv|json]\n"
+            "          [--batch GAMES [--threads 1,2,4]] [--trace REPLAY]\n"
+            "          [--snapshots WINDOW] [--stress SCALE]\n"
+            "          [--states OUT | --check-states IN [--tolerance T]]\n",
+            argv0);
+}
+
+static int parse_int_list(const char *text, int *values, int max_values, int min_value) {
+    const char *cursor = text;
+    int count = 0;
+
+    while (*cursor && count < max_values) {
+        char *end;
+        long value = strtol(cursor, &end, 10);
+
+        if (end == cursor || value < min_value) return 0;
+        values[count++] = (int)value;
+        cursor = *end == ',' ? end + 1 : end;
+    }
+    return count;
+}
+
+static int parse_options(int argc, char **argv, BenchOptions *options) {
+    int i;
+
+    memset(options, 0, sizeof(*options));
+    options->steps = 20000;
+    options->waves[0] = 1;
+    options->wave_count = 1;
+    options->seed = 1;
+    options->input_mode = BENCH_INPUT_SCRIPTED;
+    options->thread_count_runs = 1;
+    options->tolerance = DEFAULT_STATE_TOLERANCE;
+    game_default_limits(&options->limits);
+
+    for (i = 1; i < argc; ++i) {
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+
+        if (strcmp(argv[i], "--steps") == 0 && value) {
+            options->steps = strtol(value, NULL, 10);
+            ++i;
+        } else if (strcmp(argv[i], "--waves") == 0 && value) {
+            options->wave_count = parse_int_list(value, options->waves, MAX_BENCH_WAVES, 1);
+            if (options->wave_count == 0) return 0;
+            ++i;
+        } else if (strcmp(argv[i], "--enemies") == 0 && value) {
+            options->enemies = atoi(value);
+            ++i;
+        } else if (strcmp(argv[i], "--seed") == 0 && value) {
+            options->seed = (unsigned)strtoul(value, NULL, 10);
+            ++i;
+        } else if (strcmp(argv[i], "--input") == 0 && value) {
+            if (strcmp(value, "idle") == 0) options->input_mode = BENCH_INPUT_IDLE;
+            else if (strcmp(value, "scripted") == 0) options->input_mode = BENCH_INPUT_SCRIPTED;
+            else if (strcmp(value, "random") == 0) options->input_mode = BENCH_INPUT_RANDOM;
+            else return 0;
+            ++i;
+        } else if (strcmp(argv[i], "--batch") == 0 && value) {
+            options->batch_games = atoi(value);
+            ++i;
+        } else if (strcmp(argv[i], "--threads") == 0 && value) {
+            options->thread_count_runs = parse_int_list(value, options->threads, MAX_BENCH_THREAD_COUNTS, 0);
+            if (options->thread_count_runs == 0) return 0;
+            ++i;
+        } else if (strcmp(argv[i], "--trace") == 0 && value) {
+            options->trace_path = value;
+            ++i;
+        } else if (strcmp(argv[i], "--snapshots") == 0 && value) {
+            options->snapshot_window = atoi(value);
+            if (options->snapshot_window <= 0) return 0;
+            ++i;
+        } else if (strcmp(argv[i], "--states") == 0 && value) {
+            options->states_out = value;
+            ++i;
+        } else if (strcmp(argv[i], "--check-states") == 0 && value) {
+            options->states_check = value;
+            ++i;
+        } else if (strcmp(argv[i], "--tolerance") == 0 && value) {
+            options->tolerance = strtod(value, NULL);
+            if (!(options->tolerance >= 0.0)) return 0;
+            ++i;
+        } else if (strcmp(argv[i], "--stress") == 0 && value) {
+            if (atoi(value) < 1) return 0;
+            game_stress_limits(&options->limits, atoi(value));
+            ++i;
+        } else if (strcmp(argv[i], "--format") == 0 && value) {
+            if (strcmp(value, "json") == 0) options->json = 1;
+            else if (strcmp(value, "csv") == 0) options->json = 0;
+            else return 0;
+            ++i;
+        } else {
+            return 0;
+        }
+    }
+    return options->steps > 0;
+}
+
+static void make_input(BenchInputMode mode, long step, InputState *input) {
+    memset(input, 0, sizeof(*input));
+
+    if (mode == BENCH_INPUT_SCRIPTED) {
+        long phase = (step / 120) % 4;
+
+        input->right = phase == 0 || phase == 1;
+        input->left = phase == 2 || phase == 3;
+        input->up = (step / 45) % 3 == 0;
+        input->down = (step / 45) % 3 == 2;
+        input->fire = step % 4 == 0;
+        input->bomb = step % 900 == 899;
+    } else if (mode == BENCH_INPUT_RANDOM) {
+        input->left = rand() % 3 == 0;
+        input->right = rand() % 3 == 0;
+        input->up = rand() % 4 == 0;
+        input->down = rand() % 4 == 0;
+        input->fire = rand() % 2;
+        input->bomb = rand() % 600 == 0;
+    }
+}
+
+static void top_up_enemies(GameState *game, int target) {
+    while (game_active_enemy_count(game) < target) {
+        EnemyType type = (EnemyType)(rand() % 3);
+        double x = (rand() % (int)WORLD_W);
+
+        if (!game_spawn_enemy(game, type, x, 3.0 + rand() % 8, rand() % 2 ? 1 : -1)) break;
+    }
+}
+
+static void start_game(GameState *game, uint64_t seed, int wave, int enemies) {
+    game_init(game, seed);
+    if (wave > 1) game_start_wave(game, wave);
+    top_up_enemies(game, enemies);
+}
+
+static int run_wave(const BenchOptions *options, int wave, BenchResult *result) {
+    GameState game;
+    double enemy_sum = 0.0;
+    double bullet_sum = 0.0;
+    double enemy_bullet_sum = 0.0;
+    long step;
+
+    memset(result, 0, sizeof(*result));
+    result->wave = wave;
+    if (!game_create(&game, &options->limits)) return 0;
+    srand(options->seed);
+    start_game(&game, options->seed, wave, options->enemies);
+
+    for (step = 0; step < options->steps; ++step) {
+        InputState input;
+        double start;
+
+        make_input(options->input_mode, step, &input);
+        if (game.game_over) {
+            result->restarts++;
+            start_game(&game, options->seed + result->restarts, wave, options->enemies);
+        }
+        top_up_enemies(&game, options->enemies);
+
+        start = monotonic_seconds();
+        game_step_timed(&game, SIM_DT, &input, &result->phases);
+        result->seconds += monotonic_seconds() - start;
+
+        enemy_sum += game_active_enemy_count(&game);
+        bullet_sum += game_bullet_count(&game);
+        enemy_bullet_sum += game_enemy_bullet_count(&game);
+    }
+
+    result->steps = options->steps;
+    result->avg_enemies = enemy_sum / options->steps;
+    result->avg_bullets = bullet_sum / options->steps;
+    result->avg_enemy_bullets = enemy_bullet_sum / options->steps;
+    game_destroy(&game);
+    return 1;
+}
+
+/* Times game_step() over a recorded play session; wave is reported as the final wave. */
+static int run_trace(const BenchOptions *options, BenchResult *result) {
+    ReplayReader reader;
+    GameState game;
+    InputState input;
+    double enemy_sum = 0.0;
+    double bullet_sum = 0.0;
+    double enemy_bullet_sum = 0.0;
+
+    memset(result, 0, sizeof(*result));
+    if (!replay_open(&reader, options->trace_path, &game)) return 0;
+
+    while (replay_next_input(&reader, &game, &input)) {
+        double start = monotonic_seconds();
+
+        game_step_timed(&game, reader.dt, &input, &result->phases);
+        result->seconds += monotonic_seconds() - start;
+        result->steps++;
+
+        enemy_sum += game_active_enemy_count(&game);
+        bullet_sum += game_bullet_count(&game);
+        enemy_bullet_sum += game_enemy_bullet_count(&game);
+    }
+
+    result->wave = game.wave_number;
+    if (result->steps > 0) {
+        result->avg_enemies = enemy_sum / result->steps;
+        result->avg_bullets = bullet_sum / result->steps;
+        result->avg_enemy_bullets = enemy_bullet_sum / result->steps;
+    }
+    replay_close(&reader);
+    game_destroy(&game);
+    return result->steps > 0;
+}
+
+/* Pushes every step into a rollback window, then restores each stored step once. */
+static int run_snapshots(const BenchOptions *options) {
+    SnapshotRing ring;
+    GameState game;
+    int w;
+
+    if (!game_create(&game, &options->limits)) return 1;
+    if (!snapshot_ring_init(&ring, &game, options->snapshot_window, SNAPSHOT_BENCH_KEYFRAME_INTERVAL,
+                            (size_t)options->snapshot_window * game_snapshot_max_size(&game))) {
+        game_destroy(&game);
+        return 1;
+    }
+
+    if (!options->json) printf("wave,steps,push_ns,restore_ns,avg_bytes,state_bytes\n");
+    for (w = 0; w < options->wave_count; ++w) {
+        int wave = options->waves[w];
+        double push_seconds = 0.0;
+        double restore_seconds;
+        double bytes = 0.0;
+        long restores = 0;
+        long step;
+        int n;
+
+        snapshot_ring_clear(&ring);
+        srand(options->seed);
+        start_game(&game, options->seed, wave, options->enemies);
+
+        for (step = 0; step < options->steps; ++step) {
+            InputState input;
+            double start;
+
+            make_input(options->input_mode, step, &input);
+            if (game.game_over) start_game(&game, options->seed + step, wave, options->enemies);
+            top_up_enemies(&game, options->enemies);
+            game_step(&game, SIM_DT, &input);
+
+            start = monotonic_seconds();
+            snapshot_ring_push(&ring, &game, step);
+            push_seconds += monotonic_seconds() - start;
+        }
+
+        for (n = 0; n < ring.count; ++n) {
+            bytes += ring.entries[(ring.first + n) % ring.capacity].size;
+        }
+
+        restore_seconds = monotonic_seconds();
+        for (step = snapshot_ring_oldest_step(&ring); step <= snapshot_ring_newest_step(&ring); ++step) {
+            restores += snapshot_ring_restore(&ring, step, &game);
+        }
+        restore_seconds = monotonic_seconds() - restore_seconds;
+
+        if (options->json) {
+            printf("{\"wave\":%d,\"steps\":%ld,\"push_ns\":%.0f,\"restore_ns\":%.0f,"
+                   "\"avg_bytes\":%.1f,\"state_bytes\":%zu}\n",
+                   wave, options->steps, push_seconds * 1e9 / options->steps,
+                   restores ? restore_seconds * 1e9 / restores : 0.0,
+                   ring.count ? bytes / ring.count : 0.0, sizeof(GameState) + game.arena_size);
+        } else {
+            printf("%d,%ld,%.0f,%.0f,%.1f,%zu\n", wave, options->steps,
+                   push_seconds * 1e9 / options->steps,
+                   restores ? restore_seconds * 1e9 / restores : 0.0,
+                   ring.count ? bytes / ring.count : 0.0, sizeof(GameState) + game.arena_size);
+        }
+    }
+
+    snapshot_ring_free(&ring);
+    game_destroy(&game);
+    return 0;
+}
+
+/* One line per step: the discrete state, then player, human and live enemy positions. */
+static void write_state(FILE *out, const GameState *game, long step) {
+    int i;
+
+    fprintf(out, "%ld %d %d %d %d %.17g %.17g", step, game->player.score, game->player.lives,
+            game->wave_number, game->enemy_pool.count, (double)game->player.x, (double)game->player.y);
+    for (i = 0; i < MAX_HUMANS; ++i) {
+        fprintf(out, " %.17g %.17g", (double)game->humans[i].x, (double)game->humans[i].y);
+    }
+    for (i = 0; i < game->enemy_pool.count; ++i) {
+        int slot = game->enemy_pool.dense[i];
+
+        fprintf(out, " %.17g %.17g", game_enemy_x(game, slot), game_enemy_y(game, slot));
+    }
+    fprintf(out, "\n");
+}
+
+static double position_error(FILE *in, double x, double y, int *ok) {
+    double ref_x;
+    double ref_y;
+    double dx;
+    double dy;
+
+    if (fscanf(in, "%lf %lf", &ref_x, &ref_y) != 2) {
+        *ok = 0;
+        return 0.0;
+    }
+    dx = game_wrapped_dx(ref_x, x);
+    dy = y - ref_y;
+    if (dx < 0.0) dx = -dx;
+    if (dy < 0.0) dy = -dy;
+    return dx > dy ? dx : dy;
+}
+
+/* Compares this step against the next trace line; returns the largest position error, or -1
+ * if anything discrete (score, lives, wave, enemy count, the step itself) differs. */
+static double compare_state(FILE *in, const GameState *game, long step) {
+    long ref_step;
+    int score;
+    int lives;
+    int wave;
+    int enemies;
+    double error;
+    double worst;
+    int ok = 1;
+    int i;
+
+    if (fscanf(in, "%ld %d %d %d %d", &ref_step, &score, &lives, &wave, &enemies) != 5 ||
+        ref_step != step || score != game->player.score || lives != game->player.lives ||
+        wave != game->wave_number || enemies != game->enemy_pool.count) {
+        return -1.0;
+    }
+    worst = position_error(in, game->player.x, game->player.y, &ok);
+    for (i = 0; i < MAX_HUMANS; ++i) {
+        error = position_error(in, game->humans[i].x, game->humans[i].y, &ok);
+        if (error > worst) worst = error;
+    }
+    for (i = 0; i < enemies; ++i) {
+        int slot = game->enemy_pool.dense[i];
+
+        error = position_error(in, game_enemy_x(game, slot), game_enemy_y(game, slot), &ok);
+        if (error > worst) worst = error;
+    }
+    return ok ? worst : -1.0;
+}
+
+/* Writes a per-step state trace, or steps the same game against one written by another build
+ * (the double build, for a float one) and fails if it leaves the tolerance before the end. */
+static int run_states(const BenchOptions *options) {
+    const char *path = options->states_out ? options->states_out : options->states_check;
+    FILE *file = fopen(path, options->states_out ? "w" : "r");
+    GameState game;
+    double max_error = 0.0;
+    long matched = 0;
+    long step;
+    int diverged = 0;
+
+    if (!file) {
+        fprintf(stderr, "could not open %s\n", path);
+        return 1;
+    }
+    if (!game_create(&game, &options->limits)) {
+        fclose(file);
+        return 1;
+    }
+    srand(options->seed);
+    start_game(&game, options->seed, options->waves[0], options->enemies);
+
+    for (step = 0; step < options->steps && !game.game_over; ++step) {
+        InputState input;
+
+        make_input(options->input_mode, step, &input);
+        game_step(&game, SIM_DT, &input);
+        if (options->states_out) {
+            write_state(file, &game, step);
+        } else {
+            double error = compare_state(file, &game, step);
+
+            if (error < 0.0 || error > options->tolerance) {
+                diverged = 1;
+                break;
+            }
+            if (error > max_error) max_error = error;
+            matched++;
+        }
+    }
+    fclose(file);
+    game_destroy(&game);
+    if (options->states_out) return 0;
+
+    /* On a divergence the loop stopped at the failing step; diverged_at is -1 otherwise. */
+    if (options->json) {
+        printf("{\"matched_steps\":%ld,\"diverged_at\":%ld,\"max_error\":%g,\"tolerance\":%g}\n",
+               matched, diverged ? step : -1L, max_error, options->tolerance);
+    } else {
+        printf("matched_steps,diverged_at,max_error,tolerance\n%ld,%ld,%g,%g\n",
+               matched, diverged ? step : -1L, max_error, options->tolerance);
+    }
+    if (diverged) {
+        fprintf(stderr, "diverged from %s at step %ld\n", path, step);
+        return 1;
+    }
+    return 0;
+}
+
+static void print_csv_header(void) {
+    int p;
+
+    printf("wave,steps,restarts,avg_enemies,avg_bullets,avg_enemy_bullets,steps_per_sec,ns_per_step");
+    for (p = 0; p < GAME_PHASE_COUNT; ++p) {
+        printf(",ns_%s", game_phase_name((GamePhase)p));
+    }
+    printf("\n");
+}
+
+static void print_result(const BenchResult *result, int json) {
+    double steps_per_sec = result->seconds > 0.0 ? result->steps / result->seconds : 0.0;
+    double ns_per_step = result->seconds * 1e9 / result->steps;
+    int p;
+
+    if (json) {
+        printf("{\"wave\":%d,\"steps\":%ld,\"restarts\":%ld,\"avg_enemies\":%.2f,\"avg_bullets\":%.2f,"
+               "\"avg_enemy_bullets\":%.2f,\"steps_per_sec\":%.1f,\"ns_per_step\":%.1f,\"kernels\":\"%s\",\"phase_ns\":{",
+               result->wave, result->steps, result->restarts, result->avg_enemies, result->avg_bullets,
+               result->avg_enemy_bullets, steps_per_sec, ns_per_step, kernel_isa_name());
+        for (p = 0; p < GAME_PHASE_COUNT; ++p) {
+            printf("%s\"%s\":%.1f", p ? "," : "", game_phase_name((GamePhase)p),
+                   (double)result->phases.ns[p] / result->steps);
+        }
+        printf("}}\n");
+        return;
+    }
+
+    printf("%d,%ld,%ld,%.2f,%.2f,%.2f,%.1f,%.1f",
+           result->wave, result->steps, result->restarts, result->avg_enemies, result->avg_bullets,
+           result->avg_enemy_bullets, steps_per_sec, ns_per_step);
+    for (p = 0; p < GAME_PHASE_COUNT; ++p) {
+        printf(",%.1f", (double)result->phases.ns[p] / result->steps);
+    }
+    printf("\n");
+}
+
+static void batch_policy(const GameState *game, int index, long step, InputState *input, void *user) {
+    const BenchOptions *options = user;
+
+    (void)game;
+    make_input(options->input_mode == BENCH_INPUT_IDLE ? BENCH_INPUT_IDLE : BENCH_INPUT_SCRIPTED,
+               step + index * 37L, input);
+}
+
+/* Folds every game's full snapshot image together (FNV-1a), so runs with different thread
+ * counts can be compared on everything a restore would need, not just the score. image
+ * holds game_snapshot_max_size() bytes. */
+static uint64_t batch_checksum(const GameState *games, int count, unsigned char *image, size_t capacity) {
+    uint64_t hash = 14695981039346656037ULL;
+    int i;
+
+    for (i = 0; i < count; ++i) {
+        size_t size = game_snapshot_encode(&games[i], image, capacity);
+        size_t b;
+
+        for (b = 0; b < size; ++b) {
+            hash ^= image[b];
+            hash *= 1099511628211ULL;
+        }
+        hash = game_seed_mix(hash ^ size);
+    }
+    return hash;
+}
+
+static void destroy_games(GameState *games, int count) {
+    int i;
+
+    for (i = 0; i < count; ++i) game_destroy(&games[i]);
+    free(games);
+}
+
+static int run_batch(const BenchOptions *options) {
+    GameState *games = calloc((size_t)options->batch_games, sizeof(GameState));
+    unsigned char *image = NULL;
+    size_t image_capacity = 0;
+    int t;
+
+    if (!games) return 1;
+    for (t = 0; t < options->batch_games; ++t) {
+        if (!game_create(&games[t], &options->limits)) {
+            destroy_games(games, options->batch_games);
+            return 1;
+        }
+    }
+    image_capacity = game_snapshot_max_size(&games[0]);
+    image = malloc(image_capacity);
+    if (!image) {
+        destroy_games(games, options->batch_games);
+        return 1;
+    }
+
+    if (!options->json) printf("threads,games,steps,steps_per_sec,checksum\n");
+    for (t = 0; t < options->thread_count_runs; ++t) {
+        GameBatch *batch = game_batch_create(options->threads[t]);
+        double start;
+        double seconds;
+        long steps;
+
+        if (!batch) {
+            free(image);
+            destroy_games(games, options->batch_games);
+            return 1;
+        }
+
+        game_batch_init(games, options->batch_games, options->seed);
+        start = monotonic_seconds();
+        steps = game_batch_run(batch, games, options->batch_games, options->steps, SIM_DT,
+                               batch_policy, (void *)options);
+        seconds = monotonic_seconds() - start;
+
+        if (options->json) {
+            printf("{\"threads\":%d,\"games\":%d,\"steps\":%ld,\"steps_per_sec\":%.1f,\"checksum\":\"%016llx\"}\n",
+                   game_batch_thread_count(batch), options->batch_games, steps, steps / seconds,
+                   (unsigned long long)batch_checksum(games, options->batch_games, image, image_capacity));
+        } else {
+            printf("%d,%d,%ld,%.1f,%016llx\n", game_batch_thread_count(batch), options->batch_games, steps,
+                   steps / seconds,
+                   (unsigned long long)batch_checksum(games, options->batch_games, image, image_capacity));
+        }
+        game_batch_destroy(batch);
+    }
+
+    free(image);
+    destroy_games(games, options->batch_games);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    BenchOptions options;
+    int w;
+
+    if (!parse_options(argc, argv, &options)) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    if (options.batch_games > 0) return run_batch(&options);
+    if (options.states_out || options.states_check) return run_states(&options);
+    if (options.snapshot_window > 0) return run_snapshots(&options);
+    if (options.trace_path) {
+        BenchResult result;
+
+        if (!run_trace(&options, &result)) {
+            fprintf(stderr, "could not replay %s\n", options.trace_path);
+            return 1;
+        }
+        if (!options.json) print_csv_header();
+        print_result(&result, options.json);
+        return 0;
+    }
+
+    if (!options.json) print_csv_header();
+    for (w = 0; w < options.wave_count; ++w) {
+        BenchResult result;
+
+        if (!run_wave(&options, options.waves[w], &result)) {
+            fprintf(stderr, "could not allocate a game for those limits\n");
+            return 1;
+        }
+        print_result(&result, options.json);
+    }
+    return 0;
+}
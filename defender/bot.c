@@ -0,0 +1,172 @@
+#include "bot.h"
+
+#include <math.h>
+#include <string.h>
+
+/* Enemy shots that will pass this close within BOT_DODGE_HORIZON seconds are dodged;
+ * they hit at 2 units. */
+#define BOT_DODGE_MISS 3.0
+#define BOT_DODGE_HORIZON 0.6
+/* Enemy bodies inside this box are dodged; contact is at 2.5 units. */
+#define BOT_CLEARANCE_DX 8.0
+#define BOT_CLEARANCE_DY 4.0
+/* Horizontal gap kept to the enemy being hunted. */
+#define BOT_STANDOFF 24.0
+#define BOT_STANDOFF_SLACK 8.0
+/* The laser travels 90 units/s for 1.2 s. */
+#define BOT_FIRE_RANGE 100.0
+#define BOT_FIRE_DY 1.2
+/* Bomb once this many enemies are within BOT_CROWD_RADIUS. */
+#define BOT_CROWD 6
+#define BOT_CROWD_RADIUS 40.0
+/* A lander this close to the top with a human escapes soon; bomb it if out of reach. */
+#define BOT_ESCAPE_Y 5.0
+/* Height kept above the terrain, except when setting a human down. */
+#define BOT_GROUND_MARGIN 3.0
+/* Slower than the 10 units/s that crashes the ship on touchdown. */
+#define BOT_LANDING_VY 6.0
+#define BOT_PATROL_Y 8.0
+#define BOT_PATROL_VX 25.0
+/* Seconds of velocity added to the position before steering, to damp overshoot. */
+#define BOT_LOOKAHEAD 0.15
+#define BOT_DEADBAND 0.5
+
+static void steer_y(const Player *player, double target_y, InputState *input) {
+    double error = target_y - (player->y + player->vy * BOT_LOOKAHEAD);
+
+    input->down = error > BOT_DEADBAND;
+    input->up = error < -BOT_DEADBAND;
+}
+
+static void steer_x(const Player *player, double dx, InputState *input) {
+    double error = dx - player->vx * BOT_LOOKAHEAD;
+
+    input->right = error > BOT_DEADBAND;
+    input->left = error < -BOT_DEADBAND;
+}
+
+void bot_input(const GameState *game, InputState *input) {
+    const Player *player = &game->player;
+    double floor_y;
+    double human_best = WORLD_W;
+    double abductor_best = WORLD_W;
+    double enemy_best = WORLD_W;
+    double shot_best = BOT_DODGE_HORIZON;
+    double human_x = 0.0;
+    double human_y = 0.0;
+    double prey_dx = 0.0;
+    double prey_y = 0.0;
+    int dodge = 0;
+    int evade = 0;
+    int crowd = 0;
+    int escaping = 0;
+    int n;
+    int i;
+
+    memset(input, 0, sizeof(*input));
+    if (!player->active) return;
+    floor_y = game_terrain_y(player->x);
+
+    if (player->carrying_human < 0) {
+        for (i = 0; i < MAX_HUMANS; ++i) {
+            double distance;
+
+            if (game->humans[i].state != H_FALLING) continue;
+            distance = fabs(game_wrapped_dx(player->x, game->humans[i].x));
+            if (distance < human_best) {
+                human_best = distance;
+                human_x = game->humans[i].x;
+                /* It keeps falling while the ship closes in. */
+                human_y = game->humans[i].y + 1.0;
+            }
+        }
+    }
+
+    for (n = 0; n < game_active_enemy_count(game); ++n) {
+        int slot = game_enemy_slot(game, n);
+        double dx = game_wrapped_dx(player->x, game_enemy_x(game, slot));
+        double dy = game_enemy_y(game, slot) - player->y;
+        double distance = fabs(dx);
+
+        if (distance < BOT_CROWD_RADIUS && fabs(dy) < BOT_CROWD_RADIUS) crowd++;
+        if (distance < BOT_CLEARANCE_DX && fabs(dy) < BOT_CLEARANCE_DY) {
+            dodge = dy > 0.0 ? -1 : 1;
+            evade = dx > 0.0 ? -1 : 1;
+        }
+        if (distance < BOT_FIRE_RANGE && fabs(dy) < BOT_FIRE_DY && dx * player->facing > 0.0) input->fire = 1;
+
+        if (game_enemy_carrying(game, slot) >= 0) {
+            if (game_enemy_y(game, slot) < BOT_ESCAPE_Y && distance > BOT_FIRE_RANGE) escaping = 1;
+            if (distance < abductor_best) {
+                abductor_best = distance;
+                prey_dx = dx;
+                prey_y = game_enemy_y(game, slot);
+            }
+        } else if (abductor_best == WORLD_W && distance < enemy_best) {
+            enemy_best = distance;
+            prey_dx = dx;
+            prey_y = game_enemy_y(game, slot);
+        }
+    }
+
+    /* Shots outrank bodies: they are faster and more numerous. The soonest one that would
+     * pass too close, at both ships' current velocities, decides the dodge. */
+    for (i = 0; i < game_enemy_bullet_count(game); ++i) {
+        double dx = game_wrapped_dx(player->x, game_enemy_bullet_x(game, i));
+        double dy = game_enemy_bullet_y(game, i) - player->y;
+        double vx = game_enemy_bullet_vx(game, i) - player->vx;
+        double vy = game_enemy_bullet_vy(game, i) - player->vy;
+        double speed_sq = vx * vx + vy * vy;
+        double t = speed_sq > 0.0 ? -(dx * vx + dy * vy) / speed_sq : 0.0;
+        double miss_x;
+        double miss_y;
+
+        if (t < 0.0 || t >= shot_best) continue;
+        miss_x = dx + vx * t;
+        miss_y = dy + vy * t;
+        if (miss_x * miss_x + miss_y * miss_y < BOT_DODGE_MISS * BOT_DODGE_MISS) {
+            shot_best = t;
+            dodge = miss_y > 0.0 ? -1 : 1;
+        }
+    }
+
+    if (player->carrying_human >= 0) {
+        /* Settle straight down; the human is delivered on touchdown. */
+        input->down = player->vy < BOT_LANDING_VY;
+        input->up = player->vy > BOT_LANDING_VY + 2.0;
+    } else if (human_best < WORLD_W) {
+        steer_x(player, game_wrapped_dx(player->x, human_x), input);
+        steer_y(player, human_y, input);
+    } else if (abductor_best < WORLD_W || enemy_best < WORLD_W) {
+        double distance = fabs(prey_dx);
+        int toward = prey_dx > 0.0 ? 1 : -1;
+
+        /* Close to the standoff gap, and turn to face the target. */
+        if (distance > BOT_STANDOFF + BOT_STANDOFF_SLACK || player->facing != toward) {
+            steer_x(player, prey_dx, input);
+        } else if (distance < BOT_STANDOFF - BOT_STANDOFF_SLACK) {
+            steer_x(player, 0.0, input);
+        }
+        steer_y(player, prey_y, input);
+    } else {
+        /* Cruise on at BOT_PATROL_VX until something shows up. */
+        steer_x(player, player->facing * BOT_PATROL_VX * BOT_LOOKAHEAD, input);
+        steer_y(player, BOT_PATROL_Y, input);
+    }
+
+    /* Backing away turns the ship, but contact costs a life. */
+    if (evade != 0) {
+        input->left = evade < 0;
+        input->right = evade > 0;
+    }
+    if (dodge != 0) {
+        input->up = dodge < 0;
+        input->down = dodge > 0;
+    }
+    if (player->carrying_human < 0 && player->y > floor_y - BOT_GROUND_MARGIN) {
+        input->up = 1;
+        input->down = 0;
+    }
+
+    if (player->bombs > 0 && (crowd >= BOT_CROWD || escaping)) input->bomb = 1;
+}
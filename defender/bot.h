@@ -0,0 +1,13 @@
+#ifndef BOT_H
+#define BOT_H
+
+#include "game.h"
+
+/* A scripted player for balance runs: it dodges enemy shots, keeps clear of enemies and
+ * the ground, catches falling humans and lands them, and otherwise hunts abductors first,
+ * then the nearest enemy. It fires along its row and bombs crowds or a lander about to
+ * escape. The input depends only on the state, so seeded runs stay reproducible. One scan
+ * of the enemies and enemy shots per call. */
+void bot_input(const GameState *game, InputState *input);
+
+#endif
@@ -0,0 +1,47 @@
+#include "events.h"
+
+void event_ring_init(EventRing *ring) {
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->dropped, 0);
+}
+
+int event_ring_push(EventRing *ring, const GameEvent *event) {
+    unsigned head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    unsigned tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+    if (head - tail >= EVENT_RING_SIZE) {
+        atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+        return 0;
+    }
+    ring->events[head & (EVENT_RING_SIZE - 1)] = *event;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    return 1;
+}
+
+int event_ring_drain(EventRing *ring, GameEvent *out, int max) {
+    unsigned tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    unsigned head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    int count = 0;
+
+    while (tail != head && count < max) {
+        out[count++] = ring->events[tail & (EVENT_RING_SIZE - 1)];
+        tail++;
+    }
+    atomic_store_explicit(&ring->tail, tail, memory_order_release);
+    return count;
+}
+
+unsigned event_ring_dropped(EventRing *ring) {
+    return atomic_load_explicit(&ring->dropped, memory_order_relaxed);
+}
+
+const char *game_event_name(GameEventType type) {
+    static const char *names[GAME_EVENT_TYPE_COUNT] = {
+        "enemy_killed", "player_hit", "human_abducted", "human_lost",
+        "human_rescued", "wave_cleared", "wave_started", "game_over"
+    };
+
+    if (type < 0 || type >= GAME_EVENT_TYPE_COUNT) return "unknown";
+    return names[type];
+}
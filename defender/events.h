@@ -0,0 +1,60 @@
+#ifndef EVENTS_H
+#define EVENTS_H
+
+#include <stdatomic.h>
+
+/* Events per ring; a power of two. A busy wave produces a few per step. */
+#define EVENT_RING_SIZE 1024
+
+typedef enum {
+    /* subject: EnemyType, value: points awarded. */
+    GAME_EVENT_ENEMY_KILLED = 0,
+    /* subject: GameLoss, value: lives left. */
+    GAME_EVENT_PLAYER_HIT,
+    /* subject: human index, value: enemy slot. */
+    GAME_EVENT_HUMAN_ABDUCTED,
+    /* subject: human index, value: 1 if carried off the top, 0 if it fell too far. */
+    GAME_EVENT_HUMAN_LOST,
+    /* subject: human index, value: points awarded. */
+    GAME_EVENT_HUMAN_RESCUED,
+    /* subject: the wave just cleared, value: bonus points. */
+    GAME_EVENT_WAVE_CLEARED,
+    /* subject: wave number, value: enemies in the wave. */
+    GAME_EVENT_WAVE_STARTED,
+    /* subject: GameLoss, value: final score. */
+    GAME_EVENT_GAME_OVER,
+    GAME_EVENT_TYPE_COUNT
+} GameEventType;
+
+typedef struct {
+    GameEventType type;
+    /* The game_step() that emitted it, counted from 1 after game_init(); game_init()'s own
+     * wave start is step 0. */
+    unsigned step;
+    int subject;
+    int value;
+    /* Where it happened, in world units. */
+    float x;
+    float y;
+} GameEvent;
+
+/* What game_step() emits into once attached with game_set_event_ring(). One producer (the
+ * thread stepping the game) and one consumer (e.g. the render loop) may use it at the same
+ * time without locks. The producer never waits: when the consumer is a full ring behind,
+ * new events are dropped and counted. */
+typedef struct {
+    GameEvent events[EVENT_RING_SIZE];
+    atomic_uint head;
+    atomic_uint tail;
+    atomic_uint dropped;
+} EventRing;
+
+void event_ring_init(EventRing *ring);
+/* Producer. Returns 0 if the event was dropped. */
+int event_ring_push(EventRing *ring, const GameEvent *event);
+/* Consumer: copies out up to max of the oldest events and returns how many. */
+int event_ring_drain(EventRing *ring, GameEvent *out, int max);
+unsigned event_ring_dropped(EventRing *ring);
+const char *game_event_name(GameEventType type);
+
+#endif
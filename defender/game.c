@@ -1,9 +1,23 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include "game.h"
+#include "kernels.h"
+#include "monotonic.h"
 
+#ifdef DEFENDER_DEBUG
+#include <assert.h>
+#endif
 #include <math.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 
+/* Enemies further than this from the player (beyond its firing range, and past the widest
+ * view plus the sprite half-width and a step of player motion) run their AI on every
+ * GAME_AI_LOD_STRIDE-th step only, advanced by the time since their last update. Build with
+ * -DDEFENDER_FULL_AI to update every enemy every step. */
+#define AI_LOD_DISTANCE (GAME_VIEW_MAX_HALF_W + 4.0)
+
 static double clampd(double value, double min_value, double max_value) {
     if (value < min_value) return min_value;
     if (value > max_value) return max_value;
@@ -24,8 +38,25 @@ double game_wrapped_dx(double from_x, double to_x) {
     return dx;
 }
 
-double game_terrain_y(double x) {
-    double wx = game_wrap_x(x);
+uint64_t game_seed_mix(uint64_t value) {
+    value += 0x9E3779B97F4A7C15ULL;
+    value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    value = (value ^ (value >> 27)) * 0x94D049BB133111EBULL;
+    return value ^ (value >> 31);
+}
+
+/* xorshift64* drawn from the game's own state, so games never share a sequence. */
+static int game_rand(GameState *game) {
+    uint64_t x = game->rng_state;
+
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    game->rng_state = x;
+    return (int)((x * 0x2545F4914F6CDD1DULL) >> 33);
+}
+
+static double terrain_eval(double wx) {
     double ridge = sin(wx * 0.020) * 1.5;
     double swell = sin(wx * 0.047 + 1.3) * 1.1;
     double shelf = sin(wx * 0.009 - 0.8) * 0.8;
@@ -34,18 +65,180 @@ double game_terrain_y(double x) {
     return clampd(terrain, 17.0, GROUND_Y);
 }
 
+/* The terrain is not periodic, so the guard sample past WORLD_W keeps the seam where it was. */
+static double g_terrain_heights[TERRAIN_SAMPLES + 1];
+static pthread_once_t g_terrain_once = PTHREAD_ONCE_INIT;
+
+static void terrain_build(void) {
+    int i;
+
+    for (i = 0; i < TERRAIN_SAMPLES; ++i) {
+        g_terrain_heights[i] = terrain_eval(i / (double)TERRAIN_SAMPLES_PER_UNIT);
+    }
+    g_terrain_heights[TERRAIN_SAMPLES] = terrain_eval(WORLD_W);
+}
+
+static double terrain_lookup(double wx) {
+    double pos = wx * TERRAIN_SAMPLES_PER_UNIT;
+    int index = (int)pos;
+    double frac;
+
+    if (index >= TERRAIN_SAMPLES) index = TERRAIN_SAMPLES - 1;
+    frac = pos - index;
+    return g_terrain_heights[index] + (g_terrain_heights[index + 1] - g_terrain_heights[index]) * frac;
+}
+
+double game_terrain_y(double x) {
+    pthread_once(&g_terrain_once, terrain_build);
+    return terrain_lookup(game_wrap_x(x));
+}
+
+void game_terrain_span(double start_x, double step, int count, double *heights) {
+    double wx;
+    int i;
+
+    pthread_once(&g_terrain_once, terrain_build);
+
+    wx = game_wrap_x(start_x);
+    for (i = 0; i < count; ++i) {
+        heights[i] = terrain_lookup(wx);
+        wx += step;
+        if (wx >= WORLD_W) wx -= WORLD_W;
+        if (wx < 0.0) wx += WORLD_W;
+    }
+}
+
 static double distance_sq_wrapped(double ax, double ay, double bx, double by) {
     double dx = game_wrapped_dx(ax, bx);
     double dy = by - ay;
     return dx * dx + dy * dy;
 }
 
+static int grid_cell_of(double x) {
+    int cell = (int)(game_wrap_x(x) / GRID_CELL_W);
+
+    if (cell >= GRID_CELLS) cell = GRID_CELLS - 1;
+    return cell;
+}
+
+static void grid_clear(SpatialGrid *grid) {
+    int i;
+
+    for (i = 0; i < GRID_CELLS; ++i) grid->head[i] = -1;
+    for (i = 0; i < grid->capacity; ++i) {
+        grid->next[i] = -1;
+        grid->prev[i] = -1;
+        grid->cell[i] = -1;
+    }
+}
+
+static void grid_insert(SpatialGrid *grid, int item, double x) {
+    int cell = grid_cell_of(x);
+    int old_head = grid->head[cell];
+
+    grid->cell[item] = cell;
+    grid->prev[item] = -1;
+    grid->next[item] = old_head;
+    if (old_head >= 0) grid->prev[old_head] = item;
+    grid->head[cell] = item;
+}
+
+static void grid_remove(SpatialGrid *grid, int item) {
+    int cell = grid->cell[item];
+
+    if (cell < 0) return;
+
+    if (grid->prev[item] >= 0) {
+        grid->next[grid->prev[item]] = grid->next[item];
+    } else {
+        grid->head[cell] = grid->next[item];
+    }
+    if (grid->next[item] >= 0) grid->prev[grid->next[item]] = grid->prev[item];
+
+    grid->cell[item] = -1;
+    grid->next[item] = -1;
+    grid->prev[item] = -1;
+}
+
+static void grid_move(SpatialGrid *grid, int item, double x) {
+    if (grid->cell[item] == grid_cell_of(x)) return;
+
+    grid_remove(grid, item);
+    grid_insert(grid, item, x);
+}
+
+/* Visits the cells overlapping [x - radius, x + radius]; radius must be below half the world. */
+static int grid_query_cells(double x, double radius, int *first_cell) {
+    int first = (int)floor((x - radius) / GRID_CELL_W);
+    int last = (int)floor((x + radius) / GRID_CELL_W);
+    int count = last - first + 1;
+
+    if (count > GRID_CELLS) count = GRID_CELLS;
+    *first_cell = ((first % GRID_CELLS) + GRID_CELLS) % GRID_CELLS;
+    return count;
+}
+
+static void pool_init(EntityPool *pool, int capacity) {
+    int i;
+
+    pool->capacity = capacity;
+    pool->count = 0;
+    pool->free_head = capacity > 0 ? 0 : -1;
+    for (i = 0; i < capacity; ++i) {
+        pool->free_next[i] = i + 1 < capacity ? i + 1 : -1;
+        pool->dense_pos[i] = -1;
+    }
+}
+
+static int pool_acquire(EntityPool *pool) {
+    int slot = pool->free_head;
+
+    if (slot < 0) return -1;
+
+    pool->free_head = pool->free_next[slot];
+    pool->free_next[slot] = -1;
+    pool->dense[pool->count] = slot;
+    pool->dense_pos[slot] = pool->count;
+    pool->count++;
+    return slot;
+}
+
+/* Swap-removes from the dense list, so loops that release while iterating walk it backwards. */
+static void pool_release(EntityPool *pool, int slot) {
+    int pos = pool->dense_pos[slot];
+    int last;
+
+    if (pos < 0) return;
+
+    last = pool->dense[pool->count - 1];
+    pool->dense[pos] = last;
+    pool->dense_pos[last] = pos;
+    pool->dense_pos[slot] = -1;
+    pool->count--;
+
+    pool->free_next[slot] = pool->free_head;
+    pool->free_head = slot;
+}
+
 static double signum(double value) {
     if (value > 0.0) return 1.0;
     if (value < 0.0) return -1.0;
     return 0.0;
 }
 
+static void emit_event(GameState *game, GameEventType type, int subject, int value, double x, double y) {
+    GameEvent event;
+
+    if (!game->events) return;
+    event.type = type;
+    event.step = game->ai_tick;
+    event.subject = subject;
+    event.value = value;
+    event.x = (float)x;
+    event.y = (float)y;
+    event_ring_push(game->events, &event);
+}
+
 static void award_score(GameState *game, int points) {
     game->player.score += points;
     while (game->player.score >= game->next_extra_life_score) {
@@ -67,50 +260,91 @@ static int enemy_score_value(EnemyType type) {
 }
 
 static void spawn_enemy_projectile(GameState *game, double x, double y, double vx, double vy, double ttl) {
+    EnemyBullets *shots = &game->enemy_bullets;
+    int i = shots->count;
+
+    if (i >= shots->capacity) return;
+
+    shots->x[i] = game_wrap_x(x);
+    shots->y[i] = y;
+    shots->vx[i] = vx;
+    shots->vy[i] = vy;
+    shots->ttl[i] = ttl;
+    shots->count++;
+}
+
+/* Drops entries whose ttl ran out, keeping the survivors in order. */
+static void compact_bullets(Bullets *shots) {
+    int kept = 0;
     int i;
 
-    for (i = 0; i < MAX_ENEMY_BULLETS; ++i) {
-        if (!game->enemy_bullets[i].active) {
-            game->enemy_bullets[i].active = 1;
-            game->enemy_bullets[i].x = game_wrap_x(x);
-            game->enemy_bullets[i].y = y;
-            game->enemy_bullets[i].vx = vx;
-            game->enemy_bullets[i].vy = vy;
-            game->enemy_bullets[i].ttl = ttl;
-            return;
+    for (i = 0; i < shots->count; ++i) {
+        if (shots->ttl[i] <= 0.0) continue;
+        if (kept != i) {
+            shots->x[kept] = shots->x[i];
+            shots->y[kept] = shots->y[i];
+            shots->vx[kept] = shots->vx[i];
+            shots->ttl[kept] = shots->ttl[i];
         }
+        kept++;
     }
+    shots->count = kept;
 }
 
-int game_humans_in_state(const GameState *game, HumanState state) {
-    int count = 0;
+static void compact_enemy_bullets(EnemyBullets *shots) {
+    int kept = 0;
     int i;
 
-    for (i = 0; i < MAX_HUMANS; ++i) {
-        if (game->humans[i].state == state) {
-            count++;
+    for (i = 0; i < shots->count; ++i) {
+        if (shots->ttl[i] <= 0.0) continue;
+        if (kept != i) {
+            shots->x[kept] = shots->x[i];
+            shots->y[kept] = shots->y[i];
+            shots->vx[kept] = shots->vx[i];
+            shots->vy[kept] = shots->vy[i];
+            shots->ttl[kept] = shots->ttl[i];
         }
+        kept++;
     }
-    return count;
+    shots->count = kept;
 }
 
-int game_active_human_count(const GameState *game) {
-    return game_humans_in_state(game, H_GROUNDED) +
-           game_humans_in_state(game, H_FALLING) +
-           game_humans_in_state(game, H_CARRIED_BY_PLAYER) +
-           game_humans_in_state(game, H_CARRIED_BY_ENEMY);
+static void kill_enemy(GameState *game, int index) {
+    grid_remove(&game->enemy_grid, index);
+    pool_release(&game->enemy_pool, index);
 }
 
-int game_active_enemy_count(const GameState *game) {
-    int count = 0;
+/* Every human state change goes through here so human_state_counts stays exact. */
+static void set_human_state(GameState *game, int index, HumanState state) {
+    HumanState old_state = game->humans[index].state;
+
+    if (old_state == state) return;
+
+    if (old_state == H_GROUNDED || state == H_GROUNDED) game->nearest_human_dirty = 1;
+    game->human_state_counts[old_state]--;
+    game->human_state_counts[state]++;
+    game->humans[index].state = state;
+}
+
+static void count_human_states(const GameState *game, int *counts) {
     int i;
 
-    for (i = 0; i < MAX_ENEMIES; ++i) {
-        if (game->enemies[i].active) {
-            count++;
-        }
-    }
-    return count;
+    memset(counts, 0, sizeof(int) * HUMAN_STATE_COUNT);
+    for (i = 0; i < MAX_HUMANS; ++i) counts[game->humans[i].state]++;
+}
+
+int game_humans_in_state(const GameState *game, HumanState state) {
+    return game->human_state_counts[state];
+}
+
+int game_active_human_count(const GameState *game) {
+    const int *counts = game->human_state_counts;
+
+    return counts[H_GROUNDED] + counts[H_FALLING] + counts[H_CARRIED_BY_PLAYER] + counts[H_CARRIED_BY_ENEMY];
+}
+
+int game_active_enemy_count(const GameState *game) {
+    return game->enemy_pool.count;
 }
 
 static void reset_player_position(GameState *game) {
@@ -129,33 +363,162 @@ static void release_player_human(GameState *game) {
     if (game->player.carrying_human < 0) return;
 
     human_index = game->player.carrying_human;
-    game->humans[human_index].state = H_FALLING;
+    set_human_state(game, human_index, H_FALLING);
     game->humans[human_index].vy = game->player.vy;
     game->humans[human_index].x = game_wrap_x(game->player.x);
     game->humans[human_index].y = game->player.y;
     game->player.carrying_human = -1;
 }
 
-static void start_wave(GameState *game, int wave) {
+void game_start_wave(GameState *game, int wave) {
     game->wave_number = wave;
     game->wave_spawned = 0;
-    game->wave_target = 4 + wave * 2;
+    game->wave_target = (4 + wave * 2) * game->limits.wave_scale;
     game->wave_kills = 0;
-    if (game->wave_target > 24) game->wave_target = 24;
+    if (game->wave_target > game->limits.wave_target_cap) game->wave_target = game->limits.wave_target_cap;
     game->spawn_timer = 0.5;
     game->wave_clear_timer = 1.0;
     game->wave_banner_timer = 1.8;
     if (wave > 1 && game->player.bombs < 9) {
         game->player.bombs++;
     }
+    emit_event(game, GAME_EVENT_WAVE_STARTED, wave, game->wave_target, game->player.x, game->player.y);
+}
+
+void game_default_limits(GameLimits *limits) {
+    limits->max_enemies = DEFAULT_MAX_ENEMIES;
+    limits->max_bullets = DEFAULT_MAX_BULLETS;
+    limits->max_enemy_bullets = DEFAULT_MAX_ENEMY_BULLETS;
+    limits->wave_scale = 1;
+    limits->wave_target_cap = DEFAULT_WAVE_TARGET_CAP;
+}
+
+void game_stress_limits(GameLimits *limits, int scale) {
+    if (scale < 1) scale = 1;
+    game_default_limits(limits);
+    limits->max_enemies *= scale;
+    limits->max_enemy_bullets *= scale;
+    limits->wave_scale = scale;
+    limits->wave_target_cap *= scale;
+}
+
+/* Carves the next array out of the arena; with a NULL base it only measures. */
+static void *arena_take(unsigned char *base, size_t *offset, size_t count, size_t size) {
+    void *item = base ? base + *offset : NULL;
+
+    *offset += (count * size + 63) & ~(size_t)63;
+    return item;
+}
+
+static size_t bind_storage(GameState *game, unsigned char *base) {
+    const GameLimits *limits = &game->limits;
+    size_t enemies = (size_t)limits->max_enemies;
+    size_t bullets = (size_t)limits->max_bullets;
+    size_t enemy_bullets = (size_t)limits->max_enemy_bullets;
+    size_t offset = 0;
+
+    game->enemies.x = arena_take(base, &offset, enemies, sizeof(sim_real));
+    game->enemies.y = arena_take(base, &offset, enemies, sizeof(sim_real));
+    game->enemies.fire_timer = arena_take(base, &offset, enemies, sizeof(sim_real));
+    game->enemies.type = arena_take(base, &offset, enemies, sizeof(EnemyType));
+    game->enemies.carrying = arena_take(base, &offset, enemies, sizeof(int));
+    game->enemies.dir = arena_take(base, &offset, enemies, sizeof(int));
+    game->enemies.updated_tick = arena_take(base, &offset, enemies, sizeof(unsigned));
+    game->enemies.spawn_id = arena_take(base, &offset, enemies, sizeof(unsigned));
+    game->enemy_pool.free_next = arena_take(base, &offset, enemies, sizeof(int));
+    game->enemy_pool.dense = arena_take(base, &offset, enemies, sizeof(int));
+    game->enemy_pool.dense_pos = arena_take(base, &offset, enemies, sizeof(int));
+    game->enemy_grid.next = arena_take(base, &offset, enemies, sizeof(int));
+    game->enemy_grid.prev = arena_take(base, &offset, enemies, sizeof(int));
+    game->enemy_grid.cell = arena_take(base, &offset, enemies, sizeof(int));
+    game->enemy_grid.capacity = limits->max_enemies;
+
+    game->bullets.x = arena_take(base, &offset, bullets, sizeof(sim_real));
+    game->bullets.y = arena_take(base, &offset, bullets, sizeof(sim_real));
+    game->bullets.vx = arena_take(base, &offset, bullets, sizeof(sim_real));
+    game->bullets.ttl = arena_take(base, &offset, bullets, sizeof(sim_real));
+    game->bullets.capacity = limits->max_bullets;
+
+    game->enemy_bullets.x = arena_take(base, &offset, enemy_bullets, sizeof(sim_real));
+    game->enemy_bullets.y = arena_take(base, &offset, enemy_bullets, sizeof(sim_real));
+    game->enemy_bullets.vx = arena_take(base, &offset, enemy_bullets, sizeof(sim_real));
+    game->enemy_bullets.vy = arena_take(base, &offset, enemy_bullets, sizeof(sim_real));
+    game->enemy_bullets.ttl = arena_take(base, &offset, enemy_bullets, sizeof(sim_real));
+    game->enemy_bullets.capacity = limits->max_enemy_bullets;
+    return offset;
+}
+
+int game_create(GameState *game, const GameLimits *limits) {
+    memset(game, 0, sizeof(*game));
+    if (limits) game->limits = *limits;
+    else game_default_limits(&game->limits);
+
+    if (game->limits.max_enemies < 1 || game->limits.max_bullets < 1 ||
+        game->limits.max_enemy_bullets < 1 || game->limits.wave_scale < 1 ||
+        game->limits.wave_target_cap < 1) {
+        return 0;
+    }
+
+    game->arena_size = bind_storage(game, NULL);
+    game->arena = aligned_alloc(64, game->arena_size);
+    if (!game->arena) return 0;
+
+    game_clear(game);
+    return 1;
+}
+
+void game_destroy(GameState *game) {
+    free(game->arena);
+    memset(game, 0, sizeof(*game));
 }
 
-void game_init(GameState *game) {
+void game_clear(GameState *game) {
+    GameLimits limits = game->limits;
+    void *arena = game->arena;
+    size_t arena_size = game->arena_size;
+    EventRing *events = game->events;
+
+    memset(game, 0, sizeof(*game));
+    memset(arena, 0, arena_size);
+    game->limits = limits;
+    game->arena = arena;
+    game->arena_size = arena_size;
+    game->events = events;
+    game->human_state_counts[H_INACTIVE] = MAX_HUMANS;
+    bind_storage(game, arena);
+}
+
+int game_copy(GameState *dst, const GameState *src) {
+    void *arena = dst->arena;
+    EventRing *events = dst->events;
+
+    if (dst == src) return 1;
+    if (memcmp(&dst->limits, &src->limits, sizeof(dst->limits)) != 0) return 0;
+
+    memcpy(arena, src->arena, src->arena_size);
+    *dst = *src;
+    dst->arena = arena;
+    dst->events = events;
+    bind_storage(dst, arena);
+    return 1;
+}
+
+void game_set_event_ring(GameState *game, EventRing *ring) {
+    game->events = ring;
+}
+
+void game_init(GameState *game, uint64_t seed) {
     int i;
     int initial_humans = 10;
     double spacing = WORLD_W / (initial_humans + 1);
 
-    memset(game, 0, sizeof(*game));
+    pthread_once(&g_terrain_once, terrain_build);
+    game_clear(game);
+    game->seed = seed;
+    game->rng_state = game_seed_mix(seed);
+    if (game->rng_state == 0) game->rng_state = 1;
+    grid_clear(&game->enemy_grid);
+    pool_init(&game->enemy_pool, game->limits.max_enemies);
 
     game->player.bombs = 3;
     game->player.lives = 3;
@@ -168,50 +531,51 @@ void game_init(GameState *game) {
     reset_player_position(game);
 
     for (i = 0; i < initial_humans; ++i) {
-        game->humans[i].x = game_wrap_x(spacing * (i + 1) + (rand() % 9) - 4);
+        game->humans[i].x = game_wrap_x(spacing * (i + 1) + (game_rand(game) % 9) - 4);
         game->humans[i].y = game_terrain_y(game->humans[i].x);
         game->humans[i].vy = 0.0;
-        game->humans[i].state = H_GROUNDED;
+        set_human_state(game, i, H_GROUNDED);
     }
 
     game->game_over = 0;
-    start_wave(game, 1);
+    game_start_wave(game, 1);
 }
 
 static int spawn_enemy_type(GameState *game, EnemyType type, double x, double y, int dir) {
-    int i;
-
-    for (i = 0; i < MAX_ENEMIES; ++i) {
-        if (!game->enemies[i].active) {
-            game->enemies[i].active = 1;
-            game->enemies[i].type = type;
-            game->enemies[i].x = game_wrap_x(x);
-            game->enemies[i].y = y;
-            game->enemies[i].fire_timer = type == E_MUTANT
-                ? 0.45 + (rand() % 40) / 100.0
-                : 0.75 + (rand() % 90) / 100.0;
-            game->enemies[i].carrying = -1;
-            game->enemies[i].dir = dir;
-            return 1;
-        }
-    }
-    return 0;
+    Enemies *enemies = &game->enemies;
+    int i = pool_acquire(&game->enemy_pool);
+
+    if (i < 0) return 0;
+
+    enemies->type[i] = type;
+    enemies->x[i] = game_wrap_x(x);
+    enemies->y[i] = y;
+    enemies->fire_timer[i] = type == E_MUTANT
+        ? 0.45 + (game_rand(game) % 40) / 100.0
+        : 0.75 + (game_rand(game) % 90) / 100.0;
+    enemies->carrying[i] = -1;
+    enemies->dir[i] = dir;
+    /* As if updated on the step in progress (or just finished), so its first update is one step. */
+    enemies->updated_tick[i] = game->ai_tick - 1;
+    enemies->spawn_id[i] = ++game->enemy_spawns;
+    grid_insert(&game->enemy_grid, i, enemies->x[i]);
+    return 1;
 }
 
 static void spawn_wave_enemy(GameState *game) {
-    int side = rand() % 2;
+    int side = game_rand(game) % 2;
     EnemyType type = E_LANDER;
     double x = side == 0 ? 4.0 : WORLD_W - 4.0;
-    double y = 4.0 + rand() % 7;
+    double y = 4.0 + game_rand(game) % 7;
     int dir = side == 0 ? 1 : -1;
 
-    if (game->wave_number >= 3 && rand() % 100 < (game->wave_number - 2) * 8) {
+    if (game->wave_number >= 3 && game_rand(game) % 100 < (game->wave_number - 2) * 8) {
         type = E_MUTANT;
-        y = 3.0 + rand() % 6;
+        y = 3.0 + game_rand(game) % 6;
     }
-    if (game->wave_number >= 5 && type == E_LANDER && rand() % 100 < 18) {
+    if (game->wave_number >= 5 && type == E_LANDER && game_rand(game) % 100 < 18) {
         type = E_BOMBER;
-        y = 4.0 + rand() % 5;
+        y = 4.0 + game_rand(game) % 5;
     }
 
     if (spawn_enemy_type(game, type, x, y, dir)) {
@@ -219,80 +583,97 @@ static void spawn_wave_enemy(GameState *game) {
     }
 }
 
+void game_rebuild_derived(GameState *game) {
+    int n;
+
+    count_human_states(game, game->human_state_counts);
+    game->nearest_human_dirty = 1;
+    grid_clear(&game->enemy_grid);
+    for (n = 0; n < game->enemy_pool.count; ++n) {
+        int slot = game->enemy_pool.dense[n];
+
+        grid_insert(&game->enemy_grid, slot, game->enemies.x[slot]);
+    }
+}
+
+int game_spawn_enemy(GameState *game, EnemyType type, double x, double y, int dir) {
+    return spawn_enemy_type(game, type, x, y, dir);
+}
+
 static void spawn_mutant_from_human(GameState *game, double x, double y, int dir) {
     spawn_enemy_type(game, E_MUTANT, x, clampd(y, 2.0, GROUND_Y - 4.0), dir);
 }
 
 static void fire_bullet(GameState *game) {
-    int i;
+    Bullets *shots = &game->bullets;
+    int i = shots->count;
 
     if (!game->player.active || game->player.fire_timer > 0.0) return;
-
-    for (i = 0; i < MAX_BULLETS; ++i) {
-        if (!game->bullets[i].active) {
-            game->bullets[i].active = 1;
-            game->bullets[i].x = game->player.x + (game->player.facing > 0 ? 2.0 : -2.0);
-            game->bullets[i].y = game->player.y;
-            game->bullets[i].vx = game->player.facing * 90.0;
-            game->bullets[i].ttl = 1.2;
-            game->player.fire_timer = 0.13;
-            return;
-        }
-    }
+    if (i >= shots->capacity) return;
+
+    shots->x[i] = game_wrap_x(game->player.x + (game->player.facing > 0 ? 2.0 : -2.0));
+    shots->y[i] = game->player.y;
+    shots->vx[i] = game->player.facing * 90.0;
+    shots->ttl[i] = 1.2;
+    shots->count++;
+    game->player.fire_timer = 0.13;
 }
 
 static void use_bomb(GameState *game) {
-    int i;
+    int n;
 
     if (!game->player.active || game->player.bombs <= 0) return;
 
     game->player.bombs--;
-    for (i = 0; i < MAX_ENEMIES; ++i) {
-        if (!game->enemies[i].active) continue;
+    for (n = game->enemy_pool.count - 1; n >= 0; --n) {
+        int i = game->enemy_pool.dense[n];
 
-        if (game->enemies[i].carrying >= 0) {
-            int h = game->enemies[i].carrying;
+        if (game->enemies.carrying[i] >= 0) {
+            int h = game->enemies.carrying[i];
 
-            game->enemies[i].carrying = -1;
-            game->humans[h].state = H_FALLING;
+            game->enemies.carrying[i] = -1;
+            set_human_state(game, h, H_FALLING);
             game->humans[h].vy = 0.0;
         }
-        game->enemies[i].active = 0;
+        kill_enemy(game, i);
         game->wave_kills++;
         award_score(game, 50);
+        emit_event(game, GAME_EVENT_ENEMY_KILLED, game->enemies.type[i], 50, game->enemies.x[i], game->enemies.y[i]);
     }
 
-    for (i = 0; i < MAX_ENEMY_BULLETS; ++i) {
-        game->enemy_bullets[i].active = 0;
-    }
+    game->enemy_bullets.count = 0;
 }
 
-static void enemy_fire(GameState *game, const Enemy *enemy) {
+static void enemy_fire(GameState *game, int slot) {
+    double ex = game->enemies.x[slot];
+    double ey = game->enemies.y[slot];
     double dx;
     double dy;
     double dist;
 
     if (!game->player.active) return;
 
-    dx = game_wrapped_dx(enemy->x, game->player.x);
-    dy = game->player.y - enemy->y;
+    dx = game_wrapped_dx(ex, game->player.x);
+    dy = game->player.y - ey;
     dist = sqrt(dx * dx + dy * dy);
     if (dist < 1.0) dist = 1.0;
 
-    if (enemy->type == E_BOMBER) {
-        spawn_enemy_projectile(game, enemy->x - 1.0, enemy->y + 1.0, -6.0, 22.0, 1.6);
-        spawn_enemy_projectile(game, enemy->x, enemy->y + 1.0, 0.0, 24.0, 1.6);
-        spawn_enemy_projectile(game, enemy->x + 1.0, enemy->y + 1.0, 6.0, 22.0, 1.6);
+    if (game->enemies.type[slot] == E_BOMBER) {
+        spawn_enemy_projectile(game, ex - 1.0, ey + 1.0, -6.0, 22.0, 1.6);
+        spawn_enemy_projectile(game, ex, ey + 1.0, 0.0, 24.0, 1.6);
+        spawn_enemy_projectile(game, ex + 1.0, ey + 1.0, 6.0, 22.0, 1.6);
         return;
     }
 
-    spawn_enemy_projectile(game, enemy->x, enemy->y, (dx / dist) * 34.0, (dy / dist) * 34.0, 2.0);
+    spawn_enemy_projectile(game, ex, ey, (dx / dist) * 34.0, (dy / dist) * 34.0, 2.0);
 }
 
-static void damage_player(GameState *game) {
+static void damage_player(GameState *game, GameLoss cause) {
     if (!game->player.active || game->player.invulnerable_timer > 0.0 || game->game_over) return;
 
     game->player.lives--;
+    game->lives_lost[cause]++;
+    emit_event(game, GAME_EVENT_PLAYER_HIT, cause, game->player.lives, game->player.x, game->player.y);
     release_player_human(game);
     game->player.active = 0;
     game->player.vx = 0.0;
@@ -300,6 +681,8 @@ static void damage_player(GameState *game) {
 
     if (game->player.lives <= 0) {
         game->game_over = 1;
+        game->loss_cause = cause;
+        emit_event(game, GAME_EVENT_GAME_OVER, cause, game->player.score, game->player.x, game->player.y);
         game->player.respawn_timer = 0.0;
         return;
     }
@@ -357,7 +740,7 @@ static void update_player(GameState *game, double dt, const InputState *input) {
 
         if (game->player.y > floor_y) {
             if (game->player.vy > 10.0) {
-                damage_player(game);
+                damage_player(game, GAME_LOSS_CRASH);
                 return;
             }
             game->player.y = floor_y;
@@ -373,91 +756,154 @@ static void update_player(GameState *game, double dt, const InputState *input) {
         int h = game->player.carrying_human;
         double floor_y = game_terrain_y(game->player.x);
 
-        game->humans[h].state = H_GROUNDED;
+        set_human_state(game, h, H_GROUNDED);
         game->humans[h].x = game->player.x;
         game->humans[h].y = floor_y;
         game->humans[h].vy = 0.0;
         game->player.carrying_human = -1;
         award_score(game, 250);
+        emit_event(game, GAME_EVENT_HUMAN_RESCUED, h, 250, game->humans[h].x, game->humans[h].y);
     }
 }
 
+/* Returns the lowest matching slot, so the answer does not depend on bucket order. */
+static int find_enemy_near(const GameState *game, double x, double y, double radius) {
+    int best = -1;
+    int cell;
+    int cells = grid_query_cells(x, radius, &cell);
+
+    while (cells-- > 0) {
+        int e;
+
+        for (e = game->enemy_grid.head[cell]; e >= 0; e = game->enemy_grid.next[e]) {
+            if ((best < 0 || e < best) &&
+                distance_sq_wrapped(x, y, game->enemies.x[e], game->enemies.y[e]) <= radius * radius) {
+                best = e;
+            }
+        }
+        cell = (cell + 1) % GRID_CELLS;
+    }
+    return best;
+}
+
 static void update_bullets(GameState *game, double dt) {
+    Bullets *shots = &game->bullets;
+    Enemies *enemies = &game->enemies;
     int i;
-    int e;
 
-    for (i = 0; i < MAX_BULLETS; ++i) {
-        if (!game->bullets[i].active) continue;
+    kernel_advance_x(shots->x, shots->vx, shots->ttl, shots->count, dt, WORLD_W);
 
-        game->bullets[i].x += game->bullets[i].vx * dt;
-        game->bullets[i].x = game_wrap_x(game->bullets[i].x);
-        game->bullets[i].ttl -= dt;
-        if (game->bullets[i].ttl <= 0.0) {
-            game->bullets[i].active = 0;
-            continue;
-        }
+    for (i = 0; i < shots->count; ++i) {
+        int e;
 
-        for (e = 0; e < MAX_ENEMIES; ++e) {
-            if (!game->enemies[e].active) continue;
-            if (distance_sq_wrapped(game->bullets[i].x, game->bullets[i].y,
-                                    game->enemies[e].x, game->enemies[e].y) > 9.0) {
-                continue;
-            }
+        if (shots->ttl[i] <= 0.0) continue;
 
-            if (game->enemies[e].carrying >= 0) {
-                int h = game->enemies[e].carrying;
+        e = find_enemy_near(game, shots->x[i], shots->y[i], 3.0);
+        if (e < 0) continue;
 
-                game->enemies[e].carrying = -1;
-                game->humans[h].state = H_FALLING;
-                game->humans[h].vy = 0.0;
-                game->humans[h].x = game->enemies[e].x;
-                game->humans[h].y = game->enemies[e].y + 1.0;
-            }
+        if (enemies->carrying[e] >= 0) {
+            int h = enemies->carrying[e];
 
-            game->enemies[e].active = 0;
-            game->bullets[i].active = 0;
-            game->wave_kills++;
-            award_score(game, enemy_score_value(game->enemies[e].type));
-            break;
+            enemies->carrying[e] = -1;
+            set_human_state(game, h, H_FALLING);
+            game->humans[h].vy = 0.0;
+            game->humans[h].x = enemies->x[e];
+            game->humans[h].y = enemies->y[e] + 1.0;
         }
+
+        kill_enemy(game, e);
+        shots->ttl[i] = 0.0;
+        game->wave_kills++;
+        award_score(game, enemy_score_value(enemies->type[e]));
+        emit_event(game, GAME_EVENT_ENEMY_KILLED, enemies->type[e], enemy_score_value(enemies->type[e]),
+                   enemies->x[e], enemies->y[e]);
     }
+
+    compact_bullets(shots);
 }
 
 static void update_enemy_bullets(GameState *game, double dt) {
+    EnemyBullets *shots = &game->enemy_bullets;
     int i;
 
-    for (i = 0; i < MAX_ENEMY_BULLETS; ++i) {
-        if (!game->enemy_bullets[i].active) continue;
+    kernel_advance_xy(shots->x, shots->y, shots->vx, shots->vy, shots->ttl, shots->count,
+                      dt, WORLD_W, -8.0, GROUND_Y + 8.0);
 
-        game->enemy_bullets[i].x += game->enemy_bullets[i].vx * dt;
-        game->enemy_bullets[i].y += game->enemy_bullets[i].vy * dt;
-        game->enemy_bullets[i].x = game_wrap_x(game->enemy_bullets[i].x);
-        game->enemy_bullets[i].ttl -= dt;
+    for (i = 0; i < shots->count && game->player.active; ++i) {
+        if (shots->ttl[i] <= 0.0) continue;
 
-        if (game->enemy_bullets[i].ttl <= 0.0 ||
-            game->enemy_bullets[i].y < -8.0 || game->enemy_bullets[i].y > GROUND_Y + 8.0) {
-            game->enemy_bullets[i].active = 0;
-            continue;
+        if (distance_sq_wrapped(shots->x[i], shots->y[i], game->player.x, game->player.y) <= 4.0) {
+            shots->ttl[i] = 0.0;
+            damage_player(game, GAME_LOSS_SHOT);
         }
+    }
 
-        if (game->player.active &&
-            distance_sq_wrapped(game->enemy_bullets[i].x, game->enemy_bullets[i].y,
-                                game->player.x, game->player.y) <= 4.0) {
-            game->enemy_bullets[i].active = 0;
-            damage_player(game);
+    compact_enemy_bullets(shots);
+}
+
+_Static_assert(MAX_HUMANS <= 32, "nearest_human_candidates holds one bit per human");
+
+/* Wrapped distance from hx to the nearest and farthest points of [start, start + 1]. */
+static void distance_to_cell(double hx, double start, double *near_distance, double *far_distance) {
+    double to_start = fabs(game_wrapped_dx(start, hx));
+    double to_end = fabs(game_wrapped_dx(start + 1.0, hx));
+    double antipode = game_wrap_x(hx + WORLD_W / 2.0);
+
+    *near_distance = hx >= start && hx <= start + 1.0 ? 0.0 : (to_start < to_end ? to_start : to_end);
+    *far_distance = antipode >= start && antipode <= start + 1.0
+        ? WORLD_W / 2.0
+        : (to_start > to_end ? to_start : to_end);
+}
+
+/* Grounded humans never move, so the candidate sets only change when one lands, is picked
+ * up or is restored; set_human_state() marks them dirty and the next lookup rebuilds. */
+static void build_nearest_human_candidates(GameState *game) {
+    int grounded[MAX_HUMANS];
+    int grounded_count = 0;
+    int cell;
+    int i;
+
+    for (i = 0; i < MAX_HUMANS; ++i) {
+        if (game->humans[i].state == H_GROUNDED) grounded[grounded_count++] = i;
+    }
+
+    for (cell = 0; cell < NEAREST_HUMAN_CELLS; ++cell) {
+        double near_distance[MAX_HUMANS];
+        double best_far = 1e9;
+        uint32_t candidates = 0;
+
+        for (i = 0; i < grounded_count; ++i) {
+            double far_distance;
+
+            distance_to_cell(game->humans[grounded[i]].x, cell, &near_distance[i], &far_distance);
+            if (far_distance < best_far) best_far = far_distance;
         }
+        for (i = 0; i < grounded_count; ++i) {
+            if (near_distance[i] <= best_far + 1e-9) candidates |= 1u << grounded[i];
+        }
+        game->nearest_human_candidates[cell] = candidates;
     }
+    game->nearest_human_dirty = 0;
 }
 
-static int closest_grounded_human(const GameState *game, double x) {
+/* Same answer as scanning every grounded human, ties going to the lowest index. */
+static int closest_grounded_human(GameState *game, double x) {
     int best_index = -1;
     double best_distance = 1e9;
+    uint32_t candidates;
+    int cell;
     int i;
 
-    for (i = 0; i < MAX_HUMANS; ++i) {
+    if (game->nearest_human_dirty) build_nearest_human_candidates(game);
+
+    cell = (int)game_wrap_x(x);
+    if (cell >= NEAREST_HUMAN_CELLS) cell = NEAREST_HUMAN_CELLS - 1;
+
+    candidates = game->nearest_human_candidates[cell];
+    for (i = 0; candidates; ++i, candidates >>= 1) {
         double distance;
 
-        if (game->humans[i].state != H_GROUNDED) continue;
+        if (!(candidates & 1u)) continue;
 
         distance = fabs(game_wrapped_dx(x, game->humans[i].x));
         if (distance < best_distance) {
@@ -469,98 +915,113 @@ static int closest_grounded_human(const GameState *game, double x) {
     return best_index;
 }
 
-static void update_enemies(GameState *game, double dt) {
-    int i;
-
-    for (i = 0; i < MAX_ENEMIES; ++i) {
-        Enemy *enemy = &game->enemies[i];
-
-        if (!enemy->active) continue;
-
-            if (enemy->type == E_MUTANT) {
-                double dx = game->player.active ? game_wrapped_dx(enemy->x, game->player.x) : enemy->dir * 8.0;
-                double dy = game->player.active ? (game->player.y - enemy->y) : sin((enemy->x * 0.02) + i) * 2.0;
+static void update_enemies(GameState *game, double step_dt) {
+    Enemies *en = &game->enemies;
+    unsigned tick = game->ai_tick - 1;
+    int n;
 
-                enemy->dir = dx >= 0.0 ? 1 : -1;
-                enemy->x += signum(dx) * 24.0 * dt;
-                enemy->y += signum(dy) * 14.0 * dt;
-            } else if (enemy->type == E_BOMBER) {
-                enemy->x += enemy->dir * 22.0 * dt;
-                enemy->y += sin((enemy->x * 0.04) + i) * 2.2 * dt;
-        } else if (enemy->carrying >= 0) {
-            int h = enemy->carrying;
+    for (n = game->enemy_pool.count - 1; n >= 0; --n) {
+        int i = game->enemy_pool.dense[n];
+        double dt;
 
-            enemy->x += enemy->dir * 20.0 * dt;
-            enemy->y -= 12.0 * dt;
-
-            game->humans[h].state = H_CARRIED_BY_ENEMY;
-            game->humans[h].x = game_wrap_x(enemy->x);
-            game->humans[h].y = enemy->y + 1.0;
+#ifndef DEFENDER_FULL_AI
+        /* Slots take turns, so the far enemies' cost is spread evenly over the steps. */
+        if (fabs(game_wrapped_dx(en->x[i], game->player.x)) > AI_LOD_DISTANCE &&
+            (tick + (unsigned)i) % GAME_AI_LOD_STRIDE != 0) {
+            continue;
+        }
+#endif
+        /* Exact across a change of rate either way: near to far, or far to near. */
+        dt = step_dt * (double)(tick - en->updated_tick[i]);
+        en->updated_tick[i] = tick;
+
+        if (en->type[i] == E_MUTANT) {
+            double dx = game->player.active ? game_wrapped_dx(en->x[i], game->player.x) : en->dir[i] * 8.0;
+            double dy = game->player.active ? (game->player.y - en->y[i]) : sin((en->x[i] * 0.02) + i) * 2.0;
+
+            en->dir[i] = dx >= 0.0 ? 1 : -1;
+            en->x[i] += signum(dx) * 24.0 * dt;
+            en->y[i] += signum(dy) * 14.0 * dt;
+        } else if (en->type[i] == E_BOMBER) {
+            en->x[i] += en->dir[i] * 22.0 * dt;
+            en->y[i] += sin((en->x[i] * 0.04) + i) * 2.2 * dt;
+        } else if (en->carrying[i] >= 0) {
+            int h = en->carrying[i];
+
+            en->x[i] += en->dir[i] * 20.0 * dt;
+            en->y[i] -= 12.0 * dt;
+
+            set_human_state(game, h, H_CARRIED_BY_ENEMY);
+            game->humans[h].x = game_wrap_x(en->x[i]);
+            game->humans[h].y = en->y[i] + 1.0;
             game->humans[h].vy = 0.0;
 
-            if (enemy->y < -2.0) {
-                game->humans[h].state = H_LOST;
-                spawn_mutant_from_human(game, enemy->x, 3.0, enemy->dir);
-                enemy->carrying = -1;
-                enemy->active = 0;
+            if (en->y[i] < -2.0) {
+                set_human_state(game, h, H_LOST);
+                emit_event(game, GAME_EVENT_HUMAN_LOST, h, 1, game->humans[h].x, game->humans[h].y);
+                en->carrying[i] = -1;
+                kill_enemy(game, i);
+                spawn_mutant_from_human(game, en->x[i], 3.0, en->dir[i]);
                 continue;
             }
         } else {
-            int target = closest_grounded_human(game, enemy->x);
+            int target = closest_grounded_human(game, en->x[i]);
             double cruise_y = 5.0 + (i % 5);
 
             if (target >= 0) {
-                double dx = game_wrapped_dx(enemy->x, game->humans[target].x);
+                double dx = game_wrapped_dx(en->x[i], game->humans[target].x);
                 double desired_y = fabs(dx) < 8.0 ? game->humans[target].y - 1.0 : cruise_y;
                 double step_x = signum(dx) * 18.0 * dt;
-                double step_y = signum(desired_y - enemy->y) * 10.0 * dt;
+                double step_y = signum(desired_y - en->y[i]) * 10.0 * dt;
 
-                enemy->dir = dx >= 0.0 ? 1 : -1;
+                en->dir[i] = dx >= 0.0 ? 1 : -1;
                 if (fabs(dx) < fabs(step_x)) {
-                    enemy->x = game->humans[target].x;
+                    en->x[i] = game->humans[target].x;
                 } else {
-                    enemy->x += step_x;
+                    en->x[i] += step_x;
                 }
 
-                if (fabs(desired_y - enemy->y) < fabs(step_y)) {
-                    enemy->y = desired_y;
+                if (fabs(desired_y - en->y[i]) < fabs(step_y)) {
+                    en->y[i] = desired_y;
                 } else {
-                    enemy->y += step_y;
+                    en->y[i] += step_y;
                 }
 
-                if (fabs(game_wrapped_dx(enemy->x, game->humans[target].x)) <= 1.5 &&
-                    fabs(enemy->y - (game->humans[target].y - 1.0)) <= 1.5) {
-                    enemy->carrying = target;
-                    game->humans[target].state = H_CARRIED_BY_ENEMY;
-                    game->humans[target].x = game_wrap_x(enemy->x);
-                    game->humans[target].y = enemy->y + 1.0;
+                if (fabs(game_wrapped_dx(en->x[i], game->humans[target].x)) <= 1.5 &&
+                    fabs(en->y[i] - (game->humans[target].y - 1.0)) <= 1.5) {
+                    en->carrying[i] = target;
+                    set_human_state(game, target, H_CARRIED_BY_ENEMY);
+                    emit_event(game, GAME_EVENT_HUMAN_ABDUCTED, target, i, en->x[i], en->y[i]);
+                    game->humans[target].x = game_wrap_x(en->x[i]);
+                    game->humans[target].y = en->y[i] + 1.0;
                 }
             } else {
-                enemy->x += enemy->dir * 16.0 * dt;
-                enemy->y += sin((enemy->x * 0.03) + i) * 1.5 * dt;
+                en->x[i] += en->dir[i] * 16.0 * dt;
+                en->y[i] += sin((en->x[i] * 0.03) + i) * 1.5 * dt;
             }
         }
 
-        enemy->x = game_wrap_x(enemy->x);
-        enemy->y = clampd(enemy->y, 2.0, game_terrain_y(enemy->x) - 1.0);
-        enemy->fire_timer -= dt;
-        if (enemy->fire_timer <= 0.0) {
+        en->x[i] = game_wrap_x(en->x[i]);
+        en->y[i] = clampd(en->y[i], 2.0, game_terrain_y(en->x[i]) - 1.0);
+        grid_move(&game->enemy_grid, i, en->x[i]);
+        en->fire_timer[i] -= dt;
+        if (en->fire_timer[i] <= 0.0) {
             if (game->player.active &&
-                distance_sq_wrapped(enemy->x, enemy->y, game->player.x, game->player.y) <= 130.0 * 130.0) {
-                enemy_fire(game, enemy);
+                distance_sq_wrapped(en->x[i], en->y[i], game->player.x, game->player.y) <= 130.0 * 130.0) {
+                enemy_fire(game, i);
             }
-            if (enemy->type == E_MUTANT) {
-                enemy->fire_timer = 0.55 + (rand() % 35) / 100.0;
-            } else if (enemy->type == E_BOMBER) {
-                enemy->fire_timer = 0.40 + (rand() % 30) / 100.0;
+            if (en->type[i] == E_MUTANT) {
+                en->fire_timer[i] = 0.55 + (game_rand(game) % 35) / 100.0;
+            } else if (en->type[i] == E_BOMBER) {
+                en->fire_timer[i] = 0.40 + (game_rand(game) % 30) / 100.0;
             } else {
-                enemy->fire_timer = 1.0 + (rand() % 90) / 100.0;
+                en->fire_timer[i] = 1.0 + (game_rand(game) % 90) / 100.0;
             }
         }
 
         if (game->player.active &&
-            distance_sq_wrapped(enemy->x, enemy->y, game->player.x, game->player.y) <= 6.25) {
-            damage_player(game);
+            distance_sq_wrapped(en->x[i], en->y[i], game->player.x, game->player.y) <= 6.25) {
+            damage_player(game, GAME_LOSS_COLLISION);
         }
     }
 }
@@ -580,7 +1041,7 @@ static void update_humans(GameState *game, double dt) {
             if (game->player.active && game->player.carrying_human < 0 &&
                 fabs(game_wrapped_dx(human->x, game->player.x)) <= 2.0 &&
                 fabs(human->y - game->player.y) <= 1.5) {
-                human->state = H_CARRIED_BY_PLAYER;
+                set_human_state(game, i, H_CARRIED_BY_PLAYER);
                 human->vy = 0.0;
                 game->player.carrying_human = i;
                 continue;
@@ -589,15 +1050,16 @@ static void update_humans(GameState *game, double dt) {
             if (human->y >= floor_y) {
                 human->y = floor_y;
                 if (human->vy > 13.0) {
-                    human->state = H_LOST;
+                    set_human_state(game, i, H_LOST);
+                    emit_event(game, GAME_EVENT_HUMAN_LOST, i, 0, human->x, human->y);
                 } else {
-                    human->state = H_GROUNDED;
+                    set_human_state(game, i, H_GROUNDED);
                 }
                 human->vy = 0.0;
             }
         } else if (human->state == H_CARRIED_BY_PLAYER) {
             if (game->player.carrying_human != i || !game->player.active) {
-                human->state = H_FALLING;
+                set_human_state(game, i, H_FALLING);
                 human->vy = 0.0;
             } else {
                 human->x = game_wrap_x(game->player.x);
@@ -607,8 +1069,92 @@ static void update_humans(GameState *game, double dt) {
     }
 }
 
+static void update_wave(GameState *game, double dt) {
+    if (game->wave_spawned < game->wave_target) {
+        game->spawn_timer -= dt;
+        if (game->spawn_timer <= 0.0) {
+            double interval = 1.2 - game->wave_number * 0.04;
+            int burst = game->limits.wave_scale;
+
+            while (burst-- > 0 && game->wave_spawned < game->wave_target) {
+                spawn_wave_enemy(game);
+            }
+            game->spawn_timer = clampd(interval, 0.35, 1.2);
+        }
+    } else if (game_active_enemy_count(game) == 0) {
+        game->wave_clear_timer -= dt;
+        if (game->wave_clear_timer <= 0.0 && game->wave_kills >= game->wave_target) {
+            award_score(game, 500 * game->wave_number);
+            emit_event(game, GAME_EVENT_WAVE_CLEARED, game->wave_number, 500 * game->wave_number, game->player.x,
+                       game->player.y);
+            game_start_wave(game, game->wave_number + 1);
+        }
+    }
+}
+
+#ifdef DEFENDER_DEBUG
+/* Recounts everything game_step() maintains incrementally and aborts on any drift. */
+static void verify_counters(const GameState *game) {
+    const EntityPool *pool = &game->enemy_pool;
+    int counts[HUMAN_STATE_COUNT];
+    int active = 0;
+    int slot;
+
+    count_human_states(game, counts);
+    assert(memcmp(counts, game->human_state_counts, sizeof(counts)) == 0);
+
+    for (slot = 0; slot < pool->capacity; ++slot) {
+        if (pool->dense_pos[slot] >= 0) {
+            assert(pool->dense[pool->dense_pos[slot]] == slot);
+            active++;
+        }
+    }
+    assert(active == pool->count);
+}
+#endif
+
+static void phase_mark(GamePhaseTimes *times, GamePhase phase, long long *last_ns) {
+    long long now_ns;
+
+    if (!times) return;
+
+    now_ns = monotonic_ns();
+    times->ns[phase] += now_ns - *last_ns;
+    *last_ns = now_ns;
+}
+
+const char *game_phase_name(GamePhase phase) {
+    static const char *names[GAME_PHASE_COUNT] = {
+        "player", "bullets", "enemy_bullets", "enemies", "humans", "wave"
+    };
+
+    if (phase < 0 || phase >= GAME_PHASE_COUNT) return "unknown";
+    return names[phase];
+}
+
+const char *game_loss_name(GameLoss loss) {
+    static const char *names[GAME_LOSS_COUNT] = {
+        "none", "shot", "collision", "crash", "humans"
+    };
+
+    if (loss < 0 || loss >= GAME_LOSS_COUNT) return "unknown";
+    return names[loss];
+}
+
 void game_step(GameState *game, double dt, const InputState *input) {
+    game_step_timed(game, dt, input, NULL);
+}
+
+void game_step_timed(GameState *game, double dt, const InputState *input, GamePhaseTimes *times) {
+    long long last_ns = 0;
+
+#ifdef DEFENDER_DEBUG
+    verify_counters(game);
+#endif
     if (game->game_over) return;
+    if (times) last_ns = monotonic_ns();
+    /* Counted first, so every event from this step carries the same number. */
+    game->ai_tick++;
 
     if (game->wave_banner_timer > 0.0) {
         game->wave_banner_timer -= dt;
@@ -616,29 +1162,24 @@ void game_step(GameState *game, double dt, const InputState *input) {
     }
 
     update_player(game, dt, input);
+    phase_mark(times, GAME_PHASE_PLAYER, &last_ns);
     update_bullets(game, dt);
+    phase_mark(times, GAME_PHASE_BULLETS, &last_ns);
     update_enemy_bullets(game, dt);
+    phase_mark(times, GAME_PHASE_ENEMY_BULLETS, &last_ns);
     update_enemies(game, dt);
+    phase_mark(times, GAME_PHASE_ENEMIES, &last_ns);
     update_humans(game, dt);
+    phase_mark(times, GAME_PHASE_HUMANS, &last_ns);
 
     if (game_active_human_count(game) <= 0) {
         game->game_over = 1;
+        game->loss_cause = GAME_LOSS_HUMANS;
+        emit_event(game, GAME_EVENT_GAME_OVER, GAME_LOSS_HUMANS, game->player.score, game->player.x,
+                   game->player.y);
         return;
     }
 
-    if (game->wave_spawned < game->wave_target) {
-        game->spawn_timer -= dt;
-        if (game->spawn_timer <= 0.0) {
-            double interval = 1.2 - game->wave_number * 0.04;
-
-            spawn_wave_enemy(game);
-            game->spawn_timer = clampd(interval, 0.35, 1.2);
-        }
-    } else if (game_active_enemy_count(game) == 0) {
-        game->wave_clear_timer -= dt;
-        if (game->wave_clear_timer <= 0.0 && game->wave_kills >= game->wave_target) {
-            award_score(game, 500 * game->wave_number);
-            start_wave(game, game->wave_number + 1);
-        }
-    }
+    update_wave(game, dt);
+    phase_mark(times, GAME_PHASE_WAVE, &last_ns);
 }
@@ -1,15 +1,44 @@
 #ifndef GAME_H
 #define GAME_H
 
+#include "events.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
 #define WORLD_W 600.0
 #define GROUND_Y 21.0
 #define MIN_TERM_W 60
 #define MIN_TERM_H 24
 
-#define MAX_ENEMIES 64
+#define TERRAIN_SAMPLES_PER_UNIT 4
+#define TERRAIN_SAMPLES ((int)WORLD_W * TERRAIN_SAMPLES_PER_UNIT)
+
 #define MAX_HUMANS 16
-#define MAX_BULLETS 128
-#define MAX_ENEMY_BULLETS 128
+/* One-unit cells over the world for the nearest-grounded-human lookup. */
+#define NEAREST_HUMAN_CELLS ((int)WORLD_W)
+
+#define DEFAULT_MAX_ENEMIES 64
+#define DEFAULT_MAX_BULLETS 128
+#define DEFAULT_MAX_ENEMY_BULLETS 128
+#define DEFAULT_WAVE_TARGET_CAP 24
+
+#define GRID_CELL_W 8.0
+/* Renderers draw at most this far either side of the player, whatever the terminal width.
+ * Enemies further away run their AI at a reduced rate, so they must stay out of view. */
+#define GAME_VIEW_MAX_HALF_W 150
+/* Those enemies update on every GAME_AI_LOD_STRIDE-th step. */
+#define GAME_AI_LOD_STRIDE 4
+#define GRID_CELLS 75
+
+/* Storage type of entity, human and player positions, velocities and timers. Building with
+ * -DDEFENDER_SIM_FLOAT halves their footprint and doubles the projectile kernels' SIMD
+ * width; the game logic around them still computes in double. */
+#ifdef DEFENDER_SIM_FLOAT
+typedef float sim_real;
+#else
+typedef double sim_real;
+#endif
 
 typedef enum {
     H_INACTIVE = 0,
@@ -18,7 +47,8 @@ typedef enum {
     H_FALLING,
     H_CARRIED_BY_PLAYER,
     H_RESCUED,
-    H_LOST
+    H_LOST,
+    HUMAN_STATE_COUNT
 } HumanState;
 
 typedef enum {
@@ -27,48 +57,66 @@ typedef enum {
     E_BOMBER
 } EnemyType;
 
+/* Entity capacities and wave sizing, fixed for a GameState's lifetime. Each wave sends
+ * wave_scale times the usual number of enemies, wave_scale at a time, up to wave_target_cap. */
 typedef struct {
-    double x;
-    double y;
-    double fire_timer;
-    EnemyType type;
-    int active;
-    int carrying;
-    int dir;
-} Enemy;
+    int max_enemies;
+    int max_bullets;
+    int max_enemy_bullets;
+    int wave_scale;
+    int wave_target_cap;
+} GameLimits;
+
+typedef struct {
+    sim_real *x;
+    sim_real *y;
+    sim_real *fire_timer;
+    EnemyType *type;
+    int *carrying;
+    int *dir;
+    /* GameState.ai_tick of the step that last ran the enemy's AI; a far-off enemy updated
+     * every few steps is advanced by the whole time since. */
+    unsigned *updated_tick;
+    /* Which spawn occupies the slot, from GameState.enemy_spawns. Only the renderer reads it,
+     * to tell a slot refilled within one step from the enemy that was in it; snapshots leave
+     * it out, so after a decode every live slot reads 0. */
+    unsigned *spawn_id;
+} Enemies;
 
 typedef struct {
-    double x;
-    double y;
-    double vy;
+    sim_real x;
+    sim_real y;
+    sim_real vy;
     HumanState state;
 } Human;
 
 typedef struct {
-    double x;
-    double y;
-    double vx;
-    double ttl;
-    int active;
-} Bullet;
+    int count;
+    int capacity;
+    sim_real *x;
+    sim_real *y;
+    sim_real *vx;
+    sim_real *ttl;
+} Bullets;
 
 typedef struct {
-    double x;
-    double y;
-    double vx;
-    double vy;
-    double ttl;
-    int active;
-} EnemyBullet;
+    int count;
+    int capacity;
+    sim_real *x;
+    sim_real *y;
+    sim_real *vx;
+    sim_real *vy;
+    sim_real *ttl;
+} EnemyBullets;
 
 typedef struct {
-    double x;
-    double y;
-    double vx;
-    double vy;
-    double fire_timer;
-    double respawn_timer;
-    double invulnerable_timer;
+    sim_real x;
+    sim_real y;
+    sim_real vx;
+    sim_real vy;
+    sim_real fire_timer;
+    sim_real respawn_timer;
+    sim_real invulnerable_timer;
     int active;
     int bombs;
     int lives;
@@ -77,6 +125,32 @@ typedef struct {
     int carrying_human;
 } Player;
 
+typedef enum {
+    GAME_PHASE_PLAYER = 0,
+    GAME_PHASE_BULLETS,
+    GAME_PHASE_ENEMY_BULLETS,
+    GAME_PHASE_ENEMIES,
+    GAME_PHASE_HUMANS,
+    GAME_PHASE_WAVE,
+    GAME_PHASE_COUNT
+} GamePhase;
+
+/* What cost the player a life; GameState.loss_cause also says why the game ended. */
+typedef enum {
+    GAME_LOSS_NONE = 0,
+    GAME_LOSS_SHOT,
+    GAME_LOSS_COLLISION,
+    GAME_LOSS_CRASH,
+    /* Every human was lost; ends the game whatever lives are left. */
+    GAME_LOSS_HUMANS,
+    GAME_LOSS_COUNT
+} GameLoss;
+
+/* Nanoseconds spent in each update_* phase, accumulated across steps. */
+typedef struct {
+    long long ns[GAME_PHASE_COUNT];
+} GamePhaseTimes;
+
 typedef struct {
     int left;
     int right;
@@ -86,15 +160,48 @@ typedef struct {
     int bomb;
     int quit;
     int restart;
+    int toggle_profiler;
 } InputState;
 
 typedef struct {
-    Enemy enemies[MAX_ENEMIES];
+    int capacity;
+    int count;
+    int free_head;
+    int *free_next;
+    int *dense;
+    int *dense_pos;
+} EntityPool;
+
+typedef struct {
+    int capacity;
+    int head[GRID_CELLS];
+    int *next;
+    int *prev;
+    int *cell;
+} SpatialGrid;
+
+/* The entity arrays live in one arena sized from limits by game_create(), so a GameState
+ * is not copyable by assignment; use game_copy(). */
+typedef struct {
+    GameLimits limits;
+    void *arena;
+    size_t arena_size;
+    Enemies enemies;
     Human humans[MAX_HUMANS];
-    Bullet bullets[MAX_BULLETS];
-    EnemyBullet enemy_bullets[MAX_ENEMY_BULLETS];
+    int human_state_counts[HUMAN_STATE_COUNT];
+    /* Bit h is set if grounded human h can be the nearest one to some x in the cell. */
+    uint32_t nearest_human_candidates[NEAREST_HUMAN_CELLS];
+    int nearest_human_dirty;
+    Bullets bullets;
+    EnemyBullets enemy_bullets;
     Player player;
+    uint64_t seed;
+    uint64_t rng_state;
+    EntityPool enemy_pool;
+    SpatialGrid enemy_grid;
     int game_over;
+    GameLoss loss_cause;
+    int lives_lost[GAME_LOSS_COUNT];
     double spawn_timer;
     double wave_clear_timer;
     int wave_number;
@@ -103,17 +210,72 @@ typedef struct {
     int wave_kills;
     int next_extra_life_score;
     double wave_banner_timer;
+    /* Steps since game_init(); picks which far-off enemies update on a given step. */
+    unsigned ai_tick;
+    /* Enemies spawned since game_init(); numbers Enemies.spawn_id from 1. */
+    unsigned enemy_spawns;
+    /* Where game_step() emits events, or NULL. Like the arena, it stays with the GameState
+     * through game_clear() and is not taken over by game_copy(). */
+    EventRing *events;
 } GameState;
 
-void game_init(GameState *game);
+void game_default_limits(GameLimits *limits);
+/* Default limits with enemy capacity and wave sizes multiplied by scale. */
+void game_stress_limits(GameLimits *limits, int scale);
+/* Allocates storage for limits (NULL for the defaults); follow with game_init(). */
+int game_create(GameState *game, const GameLimits *limits);
+void game_destroy(GameState *game);
+/* Zeroes every field and entity array but keeps the storage. */
+void game_clear(GameState *game);
+/* Both games must have been created with the same limits. */
+int game_copy(GameState *dst, const GameState *src);
+/* Events from later steps go to ring (NULL stops them); the game never drains it. */
+void game_set_event_ring(GameState *game, EventRing *ring);
+void game_init(GameState *game, uint64_t seed);
+/* splitmix64 finalizer; spreads nearby seeds (restarts, batch indices) across the RNG space. */
+uint64_t game_seed_mix(uint64_t value);
 void game_step(GameState *game, double dt, const InputState *input);
+void game_step_timed(GameState *game, double dt, const InputState *input, GamePhaseTimes *times);
+const char *game_phase_name(GamePhase phase);
+const char *game_loss_name(GameLoss loss);
+
+/* Hooks for tools that need to set up a particular load instead of playing into it. */
+void game_start_wave(GameState *game, int wave);
+int game_spawn_enemy(GameState *game, EnemyType type, double x, double y, int dir);
+/* Recomputes the enemy collision grid and human-state counts from entity state, e.g. after
+ * restoring a snapshot. */
+void game_rebuild_derived(GameState *game);
 
 double game_wrap_x(double x);
 double game_wrapped_dx(double from_x, double to_x);
+/* Reads the sampled heightfield, building it on first use. */
 double game_terrain_y(double x);
+/* Fills heights[i] with the terrain at start_x + i * step; |step| must be below WORLD_W. */
+void game_terrain_span(double start_x, double step, int count, double *heights);
 
+/* O(1): counts are kept up to date on every state change (checked with -DDEFENDER_DEBUG). */
 int game_humans_in_state(const GameState *game, HumanState state);
 int game_active_human_count(const GameState *game);
 int game_active_enemy_count(const GameState *game);
 
+/* Enemies keep stable slots; the n-th active one lives at game_enemy_slot(game, n). */
+static inline int game_enemy_slot(const GameState *game, int n) { return game->enemy_pool.dense[n]; }
+static inline double game_enemy_x(const GameState *game, int slot) { return game->enemies.x[slot]; }
+static inline double game_enemy_y(const GameState *game, int slot) { return game->enemies.y[slot]; }
+static inline EnemyType game_enemy_type(const GameState *game, int slot) { return game->enemies.type[slot]; }
+static inline unsigned game_enemy_spawn_id(const GameState *game, int slot) { return game->enemies.spawn_id[slot]; }
+/* The human an enemy is carrying off, or -1. */
+static inline int game_enemy_carrying(const GameState *game, int slot) { return game->enemies.carrying[slot]; }
+
+/* Projectiles are packed: indices 0..count-1 are all live. */
+static inline int game_bullet_count(const GameState *game) { return game->bullets.count; }
+static inline double game_bullet_x(const GameState *game, int i) { return game->bullets.x[i]; }
+static inline double game_bullet_y(const GameState *game, int i) { return game->bullets.y[i]; }
+
+static inline int game_enemy_bullet_count(const GameState *game) { return game->enemy_bullets.count; }
+static inline double game_enemy_bullet_x(const GameState *game, int i) { return game->enemy_bullets.x[i]; }
+static inline double game_enemy_bullet_y(const GameState *game, int i) { return game->enemy_bullets.y[i]; }
+static inline double game_enemy_bullet_vx(const GameState *game, int i) { return game->enemy_bullets.vx[i]; }
+static inline double game_enemy_bullet_vy(const GameState *game, int i) { return game->enemy_bullets.vy[i]; }
+
 #endif
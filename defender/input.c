@@ -1,7 +1,40 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include "input.h"
+#include "monotonic.h"
 
-#include <ncurses.h>
+#include <errno.h>
+#include <poll.h>
 #include <string.h>
+#include <unistd.h>
+
+/* A lone ESC is dropped once nothing has followed it for this long. */
+#define INPUT_ESCAPE_TIMEOUT 0.05
+/* How long to wait for the terminal to answer the keyboard protocol query. */
+#define INPUT_QUERY_TIMEOUT 0.5
+/* Kitty keyboard protocol flags: disambiguate escape codes, report event types. */
+#define INPUT_KITTY_FLAGS "3"
+
+typedef enum {
+    INPUT_KEY_NONE = 0,
+    INPUT_KEY_LEFT,
+    INPUT_KEY_RIGHT,
+    INPUT_KEY_UP,
+    INPUT_KEY_DOWN,
+    INPUT_KEY_CHAR
+} InputKeyKind;
+
+typedef enum {
+    INPUT_EVENT_PRESS = 1,
+    INPUT_EVENT_REPEAT,
+    INPUT_EVENT_RELEASE
+} InputKeyEvent;
+
+typedef struct {
+    InputKeyKind kind;
+    int ch;
+    InputKeyEvent event;
+} InputKey;
 
 static int key_still_held(double last_seen, double now_seconds, double hold_seconds) {
     return (now_seconds - last_seen) <= hold_seconds;
@@ -16,47 +49,385 @@ void input_init(InputContext *context) {
     context->down_seen = -1000.0;
 }
 
-void input_poll(InputContext *context, InputState *state, double now_seconds) {
-    int ch;
+static InputKeyKind arrow_kind(unsigned char final) {
+    switch (final) {
+        case 'A': return INPUT_KEY_UP;
+        case 'B': return INPUT_KEY_DOWN;
+        case 'C': return INPUT_KEY_RIGHT;
+        case 'D': return INPUT_KEY_LEFT;
+        default: return INPUT_KEY_NONE;
+    }
+}
 
-    memset(state, 0, sizeof(*state));
+/* Decodes the key at bytes[0]: plain characters, arrows as CSI (ESC [ ... A) or, in keypad
+ * transmit mode, SS3 (ESC O A), and the kitty protocol's ESC [ code ; mods : event u and
+ * ESC [ 1 ; mods : event A. Returns the bytes it used, or 0 if the sequence is still
+ * incomplete. */
+static int decode_key(const unsigned char *bytes, int length, InputKey *key) {
+    /* The first two parameters and their first two sub-parameters, with their defaults. */
+    int values[2][2] = {{1, 0}, {1, INPUT_EVENT_PRESS}};
+    int param = 0;
+    int sub = 0;
+    int digits = 0;
+    int i;
 
-    while ((ch = getch()) != ERR) {
-        switch (ch) {
-            case KEY_LEFT:
-                context->left_seen = now_seconds;
-                break;
-            case KEY_RIGHT:
-                context->right_seen = now_seconds;
-                break;
-            case KEY_UP:
-                context->up_seen = now_seconds;
-                break;
-            case KEY_DOWN:
-                context->down_seen = now_seconds;
-                break;
-            case ' ':
-                state->fire = 1;
-                break;
-            case 'b':
-            case 'B':
-                state->bomb = 1;
-                break;
-            case 'r':
-            case 'R':
-                state->restart = 1;
-                break;
-            case 'q':
-            case 'Q':
-                state->quit = 1;
-                break;
-            default:
-                break;
+    key->kind = INPUT_KEY_NONE;
+    key->ch = 0;
+    key->event = INPUT_EVENT_PRESS;
+    if (bytes[0] != 0x1b) {
+        key->kind = INPUT_KEY_CHAR;
+        key->ch = bytes[0];
+        return 1;
+    }
+    if (length < 2) return 0;
+    if (bytes[1] == 'O') {
+        if (length < 3) return 0;
+        key->kind = arrow_kind(bytes[2]);
+        return 3;
+    }
+    if (bytes[1] != '[') return 1;
+
+    for (i = 2; i < length; ++i) {
+        unsigned char byte = bytes[i];
+
+        if (byte >= '0' && byte <= '9') {
+            if (param < 2 && sub < 2) {
+                if (digits++ == 0) values[param][sub] = 0;
+                if (values[param][sub] < 100000) values[param][sub] = values[param][sub] * 10 + byte - '0';
+            }
+        } else if (byte == ';') {
+            ++param;
+            sub = 0;
+            digits = 0;
+        } else if (byte == ':') {
+            ++sub;
+            digits = 0;
+        } else if (byte >= 0x40 && byte <= 0x7e) {
+            /* ESC [ ? ... is a reply to a query, not a key. */
+            if (bytes[2] == '?') return i + 1;
+            if (values[1][1] >= INPUT_EVENT_PRESS && values[1][1] <= INPUT_EVENT_RELEASE) {
+                key->event = (InputKeyEvent)values[1][1];
+            }
+            if (byte == 'u') {
+                key->kind = INPUT_KEY_CHAR;
+                key->ch = values[0][0];
+            } else {
+                key->kind = arrow_kind(byte);
+            }
+            return i + 1;
+        } else if (byte < 0x20 || byte > 0x3f) {
+            return i;
         }
     }
+    return 0;
+}
+
+/* Returns 1 if the key is meant for the sim rather than the render loop. */
+static int apply_key(InputContext *context, const InputKey *key, InputState *state, double now_seconds) {
+    int down = key->event != INPUT_EVENT_RELEASE;
+
+    switch (key->kind) {
+        case INPUT_KEY_LEFT:
+            context->left_seen = now_seconds;
+            context->left_down = down;
+            return 1;
+        case INPUT_KEY_RIGHT:
+            context->right_seen = now_seconds;
+            context->right_down = down;
+            return 1;
+        case INPUT_KEY_UP:
+            context->up_seen = now_seconds;
+            context->up_down = down;
+            return 1;
+        case INPUT_KEY_DOWN:
+            context->down_seen = now_seconds;
+            context->down_down = down;
+            return 1;
+        case INPUT_KEY_CHAR:
+            if (!down) return 0;
+            break;
+        default:
+            return 0;
+    }
+
+    switch (key->ch) {
+        case ' ':
+            state->fire = 1;
+            return 1;
+        case 'b':
+        case 'B':
+            state->bomb = 1;
+            return 1;
+        case 'r':
+        case 'R':
+            state->restart = 1;
+            return 1;
+        case 'p':
+        case 'P':
+            state->toggle_profiler = 1;
+            return 0;
+        case 'q':
+        case 'Q':
+            state->quit = 1;
+            return 0;
+        default:
+            return 0;
+    }
+}
 
+static void held_directions(const InputContext *context, InputState *state, double now_seconds) {
+    if (context->key_release) {
+        state->left = context->left_down;
+        state->right = context->right_down;
+        state->up = context->up_down;
+        state->down = context->down_down;
+        return;
+    }
     state->left = key_still_held(context->left_seen, now_seconds, context->key_hold_seconds);
     state->right = key_still_held(context->right_seen, now_seconds, context->key_hold_seconds);
     state->up = key_still_held(context->up_seen, now_seconds, context->key_hold_seconds);
     state->down = key_still_held(context->down_seen, now_seconds, context->key_hold_seconds);
 }
+
+/* Seconds until a held direction expires, or -1 if none is held. */
+static double next_release(const InputContext *context, double now_seconds) {
+    double seen[4];
+    double next = -1.0;
+    int i;
+
+    if (context->key_release) return -1.0;
+    seen[0] = context->left_seen;
+    seen[1] = context->right_seen;
+    seen[2] = context->up_seen;
+    seen[3] = context->down_seen;
+    for (i = 0; i < 4; ++i) {
+        double remain = seen[i] + context->key_hold_seconds - now_seconds;
+
+        if (remain >= 0.0 && (next < 0.0 || remain < next)) next = remain;
+    }
+    return next;
+}
+
+static void record_key(InputThread *input, double stamp) {
+    unsigned head = atomic_load_explicit(&input->key_head, memory_order_relaxed);
+    unsigned tail = atomic_load_explicit(&input->key_tail, memory_order_acquire);
+
+    if (head - tail >= INPUT_KEY_RING_SIZE) return;
+    input->keys[head & (INPUT_KEY_RING_SIZE - 1)].push = input->pushed;
+    input->keys[head & (INPUT_KEY_RING_SIZE - 1)].stamp = stamp;
+    atomic_store_explicit(&input->key_head, head + 1, memory_order_release);
+}
+
+/* Queues state if it says anything the sim hasn't heard yet; keys counts the key presses
+ * behind it, each of which is timed until it reaches the screen. */
+static void send_state(InputThread *input, const InputState *state, int keys, double stamp) {
+    int changed = state->left != input->sent.left || state->right != input->sent.right ||
+                  state->up != input->sent.up || state->down != input->sent.down;
+
+    if (!changed && !state->fire && !state->bomb && !state->restart) return;
+    if (!sim_push_input(input->sim, state)) return;
+
+    input->pushed++;
+    input->sent = *state;
+    while (keys-- > 0) record_key(input, stamp);
+}
+
+/* Decodes everything buffered; an escape sequence cut off by the end of a read waits for
+ * the rest unless it has already waited INPUT_ESCAPE_TIMEOUT. */
+static void handle_bytes(InputThread *input, double now_seconds) {
+    InputState state;
+    int offset = 0;
+    int keys = 0;
+
+    memset(&state, 0, sizeof(state));
+    while (offset < input->pending_length) {
+        InputKey key;
+        int used = decode_key(input->pending + offset, input->pending_length - offset, &key);
+
+        if (used == 0) {
+            if (now_seconds - input->pending_since < INPUT_ESCAPE_TIMEOUT &&
+                input->pending_length < INPUT_PENDING_MAX) {
+                break;
+            }
+            used = 1;
+        }
+        offset += used;
+        keys += apply_key(&input->context, &key, &state, now_seconds);
+    }
+    memmove(input->pending, input->pending + offset, (size_t)(input->pending_length - offset));
+    input->pending_length -= offset;
+    if (offset > 0) input->pending_since = now_seconds;
+
+    if (state.quit) atomic_store_explicit(&input->quit, 1, memory_order_release);
+    if (state.toggle_profiler) atomic_fetch_add_explicit(&input->profiler_toggles, 1, memory_order_release);
+    if (state.restart) {
+        int key_release = input->context.key_release;
+
+        input_init(&input->context);
+        input->context.key_release = key_release;
+    }
+    held_directions(&input->context, &state, now_seconds);
+    send_state(input, &state, keys, now_seconds);
+}
+
+static int write_all(int fd, const char *bytes, size_t length) {
+    while (length > 0) {
+        ssize_t wrote = write(fd, bytes, length);
+
+        if (wrote < 0) {
+            if (errno == EINTR) continue;
+            return 0;
+        }
+        bytes += wrote;
+        length -= (size_t)wrote;
+    }
+    return 1;
+}
+
+/* Sends ESC [ ? u (current keyboard flags, answered only by kitty-protocol terminals) and
+ * then a primary device attributes request, which every terminal answers, so the wait ends
+ * as soon as the DA reply is in. Any keys typed meanwhile are dropped. */
+int input_enable_key_release(int in_fd, int out_fd) {
+    static const char query[] = "\x1b[?u\x1b[c";
+    static const char enable[] = "\x1b[>" INPUT_KITTY_FLAGS "u";
+    unsigned char reply[INPUT_PENDING_MAX];
+    int length = 0;
+    int supported = 0;
+    int answered = 0;
+    double deadline;
+
+    if (!isatty(in_fd) || !isatty(out_fd)) return 0;
+    if (!write_all(out_fd, query, sizeof(query) - 1)) return 0;
+
+    deadline = monotonic_seconds() + INPUT_QUERY_TIMEOUT;
+    while (!answered) {
+        struct pollfd fds;
+        double remain = deadline - monotonic_seconds();
+        ssize_t got;
+        int offset = 0;
+
+        if (remain <= 0.0) break;
+        fds.fd = in_fd;
+        fds.events = POLLIN;
+        if (poll(&fds, 1, (int)(remain * 1e3) + 1) <= 0) continue;
+        got = read(in_fd, reply + length, sizeof(reply) - (size_t)length);
+        if (got <= 0) {
+            if (got < 0 && errno == EINTR) continue;
+            break;
+        }
+        length += (int)got;
+
+        while (offset < length) {
+            InputKey key;
+            int used = decode_key(reply + offset, length - offset, &key);
+
+            if (used == 0) break;
+            if (used >= 4 && reply[offset] == 0x1b && reply[offset + 2] == '?') {
+                if (reply[offset + used - 1] == 'u') supported = 1;
+                if (reply[offset + used - 1] == 'c') answered = 1;
+            }
+            offset += used;
+        }
+        if (offset == 0 && length == (int)sizeof(reply)) offset = length;
+        memmove(reply, reply + offset, (size_t)(length - offset));
+        length -= offset;
+    }
+
+    if (supported && !write_all(out_fd, enable, sizeof(enable) - 1)) supported = 0;
+    return supported;
+}
+
+void input_disable_key_release(int out_fd) {
+    write_all(out_fd, "\x1b[<u", 4);
+}
+
+static void *input_main(void *arg) {
+    InputThread *input = arg;
+    struct pollfd fds[2];
+
+    fds[0].fd = input->fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = input->wake[0];
+    fds[1].events = POLLIN;
+
+    while (!atomic_load_explicit(&input->quit, memory_order_acquire)) {
+        double now_seconds = monotonic_seconds();
+        double release = next_release(&input->context, now_seconds);
+        int timeout = -1;
+        int ready;
+
+        if (release >= 0.0) timeout = (int)(release * 1e3) + 1;
+        if (input->pending_length > 0) timeout = (int)(INPUT_ESCAPE_TIMEOUT * 1e3) + 1;
+
+        ready = poll(fds, 2, timeout);
+        if (ready < 0 && errno != EINTR) break;
+        if (fds[1].revents) break;
+
+        now_seconds = monotonic_seconds();
+        if (ready > 0 && fds[0].revents) {
+            ssize_t got = read(input->fd, input->pending + input->pending_length,
+                               (size_t)(INPUT_PENDING_MAX - input->pending_length));
+
+            /* The terminal went away; keep running on releases alone. */
+            if (got == 0 || (got < 0 && errno != EINTR && errno != EAGAIN)) fds[0].fd = -1;
+            if (got > 0) {
+                if (input->pending_length == 0) input->pending_since = now_seconds;
+                input->pending_length += (int)got;
+            }
+        }
+        handle_bytes(input, now_seconds);
+    }
+    return NULL;
+}
+
+int input_thread_start(InputThread *input, SimThread *sim, int fd, int key_release) {
+    memset(input, 0, sizeof(*input));
+    input_init(&input->context);
+    input->context.key_release = key_release;
+    input->sim = sim;
+    input->fd = fd;
+    atomic_init(&input->quit, 0);
+    atomic_init(&input->profiler_toggles, 0);
+    atomic_init(&input->key_head, 0);
+    atomic_init(&input->key_tail, 0);
+
+    if (pipe(input->wake) != 0) return 0;
+    if (pthread_create(&input->thread, NULL, input_main, input) != 0) {
+        close(input->wake[0]);
+        close(input->wake[1]);
+        return 0;
+    }
+    return 1;
+}
+
+void input_thread_stop(InputThread *input) {
+    char byte = 0;
+
+    while (write(input->wake[1], &byte, 1) < 0 && errno == EINTR) {
+    }
+    pthread_join(input->thread, NULL);
+    close(input->wake[0]);
+    close(input->wake[1]);
+}
+
+int input_quit_requested(InputThread *input) {
+    return atomic_load_explicit(&input->quit, memory_order_acquire);
+}
+
+int input_profiler_toggles(InputThread *input) {
+    return atomic_load_explicit(&input->profiler_toggles, memory_order_acquire);
+}
+
+int input_next_shown_key(InputThread *input, unsigned inputs_taken, double *stamp) {
+    unsigned tail = atomic_load_explicit(&input->key_tail, memory_order_relaxed);
+    unsigned head = atomic_load_explicit(&input->key_head, memory_order_acquire);
+    const InputKeyStamp *key;
+
+    if (tail == head) return 0;
+    key = &input->keys[tail & (INPUT_KEY_RING_SIZE - 1)];
+    if ((int)(inputs_taken - key->push) < 0) return 0;
+
+    *stamp = key->stamp;
+    atomic_store_explicit(&input->key_tail, tail + 1, memory_order_release);
+    return 1;
+}
@@ -2,6 +2,15 @@
 #define INPUT_H
 
 #include "game.h"
+#include "sim.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+/* Keys queued for the sim but not yet seen on screen by the render loop; a power of two. */
+#define INPUT_KEY_RING_SIZE 256
+/* Longest escape sequence the decoder buffers. */
+#define INPUT_PENDING_MAX 32
 
 typedef struct {
     double key_hold_seconds;
@@ -9,9 +18,66 @@ typedef struct {
     double right_seen;
     double up_seen;
     double down_seen;
+    /* Set when the terminal reports key releases; directions are then held from press to
+     * release and key_hold_seconds is unused. */
+    int key_release;
+    int left_down;
+    int right_down;
+    int up_down;
+    int down_down;
 } InputContext;
 
+typedef struct {
+    /* The key is on screen once the sim has taken this many inputs. */
+    unsigned push;
+    double stamp;
+} InputKeyStamp;
+
+/* Blocks in poll() on the terminal, decodes keys as they arrive and queues the resulting
+ * InputState straight to the sim thread, so input latency doesn't depend on the frame rate.
+ * Without key release events, held directions expire key_hold_seconds after the last
+ * repeat; the thread wakes at that moment to queue the release. Quit and the profiler
+ * toggle go to the render loop. */
+typedef struct {
+    InputContext context;
+    SimThread *sim;
+    int fd;
+    int wake[2];
+    unsigned char pending[INPUT_PENDING_MAX];
+    int pending_length;
+    double pending_since;
+    InputState sent;
+    unsigned pushed;
+
+    atomic_int quit;
+    atomic_int profiler_toggles;
+
+    /* Single-producer (this thread) single-consumer (the render loop) ring. */
+    InputKeyStamp keys[INPUT_KEY_RING_SIZE];
+    atomic_uint key_head;
+    atomic_uint key_tail;
+
+    pthread_t thread;
+} InputThread;
+
 void input_init(InputContext *context);
-void input_poll(InputContext *context, InputState *state, double now_seconds);
+
+/* Asks the terminal whether it speaks the kitty keyboard protocol and, if so, turns on
+ * press/repeat/release reporting. Call after the screen is set up and before the input
+ * thread starts; returns 1 if releases will be reported. */
+int input_enable_key_release(int in_fd, int out_fd);
+/* Restores the terminal's previous keyboard mode; call before endwin(). */
+void input_disable_key_release(int out_fd);
+
+/* fd must already be in cbreak mode (initscr() and cbreak() do that). key_release is the
+ * result of input_enable_key_release(). */
+int input_thread_start(InputThread *input, SimThread *sim, int fd, int key_release);
+void input_thread_stop(InputThread *input);
+int input_quit_requested(InputThread *input);
+/* Counts P presses; the render loop compares it with the last value it saw. */
+int input_profiler_toggles(InputThread *input);
+/* Render loop, after presenting a frame whose sim had taken inputs_taken inputs: pops the
+ * oldest key that frame shows and its CLOCK_MONOTONIC timestamp. */
+int input_next_shown_key(InputThread *input, unsigned inputs_taken, double *stamp);
 
 #endif
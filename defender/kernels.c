@@ -0,0 +1,176 @@
+#include "kernels.h"
+
+/* One generic SIMD body per kernel, instantiated through these per-ISA wrappers.
+ * A float build packs twice as many lanes into the same registers. */
+#if defined(DEFENDER_SCALAR_KERNELS)
+#define KERNEL_LANES 1
+#elif defined(__AVX__)
+#include <immintrin.h>
+#ifdef DEFENDER_SIM_FLOAT
+#define KERNEL_LANES 8
+typedef __m256 kvec;
+#define kv_load _mm256_loadu_ps
+#define kv_store _mm256_storeu_ps
+#define kv_set1 _mm256_set1_ps
+#define kv_zero _mm256_setzero_ps
+#define kv_add _mm256_add_ps
+#define kv_sub _mm256_sub_ps
+#define kv_mul _mm256_mul_ps
+#define kv_and _mm256_and_ps
+#define kv_andnot _mm256_andnot_ps
+#define kv_or _mm256_or_ps
+#define kv_lt(a, b) _mm256_cmp_ps(a, b, _CMP_LT_OQ)
+#define kv_gt(a, b) _mm256_cmp_ps(a, b, _CMP_GT_OQ)
+#define kv_ge(a, b) _mm256_cmp_ps(a, b, _CMP_GE_OQ)
+#else
+#define KERNEL_LANES 4
+typedef __m256d kvec;
+#define kv_load _mm256_loadu_pd
+#define kv_store _mm256_storeu_pd
+#define kv_set1 _mm256_set1_pd
+#define kv_zero _mm256_setzero_pd
+#define kv_add _mm256_add_pd
+#define kv_sub _mm256_sub_pd
+#define kv_mul _mm256_mul_pd
+#define kv_and _mm256_and_pd
+#define kv_andnot _mm256_andnot_pd
+#define kv_or _mm256_or_pd
+#define kv_lt(a, b) _mm256_cmp_pd(a, b, _CMP_LT_OQ)
+#define kv_gt(a, b) _mm256_cmp_pd(a, b, _CMP_GT_OQ)
+#define kv_ge(a, b) _mm256_cmp_pd(a, b, _CMP_GE_OQ)
+#endif
+#define KERNEL_ISA "avx"
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#ifdef DEFENDER_SIM_FLOAT
+#define KERNEL_LANES 4
+typedef __m128 kvec;
+#define kv_load _mm_loadu_ps
+#define kv_store _mm_storeu_ps
+#define kv_set1 _mm_set1_ps
+#define kv_zero _mm_setzero_ps
+#define kv_add _mm_add_ps
+#define kv_sub _mm_sub_ps
+#define kv_mul _mm_mul_ps
+#define kv_and _mm_and_ps
+#define kv_andnot _mm_andnot_ps
+#define kv_or _mm_or_ps
+#define kv_lt _mm_cmplt_ps
+#define kv_gt _mm_cmpgt_ps
+#define kv_ge _mm_cmpge_ps
+#else
+#define KERNEL_LANES 2
+typedef __m128d kvec;
+#define kv_load _mm_loadu_pd
+#define kv_store _mm_storeu_pd
+#define kv_set1 _mm_set1_pd
+#define kv_zero _mm_setzero_pd
+#define kv_add _mm_add_pd
+#define kv_sub _mm_sub_pd
+#define kv_mul _mm_mul_pd
+#define kv_and _mm_and_pd
+#define kv_andnot _mm_andnot_pd
+#define kv_or _mm_or_pd
+#define kv_lt _mm_cmplt_pd
+#define kv_gt _mm_cmpgt_pd
+#define kv_ge _mm_cmpge_pd
+#endif
+#define KERNEL_ISA "sse2"
+#else
+#define KERNEL_LANES 1
+#endif
+
+static sim_real wrap_once(sim_real x, sim_real world_w) {
+    if (x < 0) x += world_w;
+    if (x >= world_w) x -= world_w;
+    return x;
+}
+
+static void advance_x_scalar(sim_real *x, const sim_real *vx, sim_real *ttl, int start, int count,
+                             sim_real dt, sim_real world_w) {
+    int i;
+
+    for (i = start; i < count; ++i) {
+        x[i] = wrap_once(x[i] + vx[i] * dt, world_w);
+        ttl[i] -= dt;
+    }
+}
+
+static void advance_xy_scalar(sim_real *x, sim_real *y, const sim_real *vx, const sim_real *vy, sim_real *ttl,
+                              int start, int count, sim_real dt, sim_real world_w,
+                              sim_real min_y, sim_real max_y) {
+    int i;
+
+    for (i = start; i < count; ++i) {
+        x[i] = wrap_once(x[i] + vx[i] * dt, world_w);
+        y[i] += vy[i] * dt;
+        ttl[i] -= dt;
+        if (y[i] < min_y || y[i] > max_y) ttl[i] = 0;
+    }
+}
+
+#if KERNEL_LANES > 1
+
+void kernel_advance_x(sim_real *x, const sim_real *vx, sim_real *ttl, int count, double dt, double world_w) {
+    kvec vdt = kv_set1((sim_real)dt);
+    kvec vw = kv_set1((sim_real)world_w);
+    kvec zero = kv_zero();
+    int i;
+
+    for (i = 0; i + KERNEL_LANES <= count; i += KERNEL_LANES) {
+        kvec px = kv_add(kv_load(x + i), kv_mul(kv_load(vx + i), vdt));
+
+        px = kv_add(px, kv_and(kv_lt(px, zero), vw));
+        px = kv_sub(px, kv_and(kv_ge(px, vw), vw));
+        kv_store(x + i, px);
+        kv_store(ttl + i, kv_sub(kv_load(ttl + i), vdt));
+    }
+    advance_x_scalar(x, vx, ttl, i, count, (sim_real)dt, (sim_real)world_w);
+}
+
+void kernel_advance_xy(sim_real *x, sim_real *y, const sim_real *vx, const sim_real *vy, sim_real *ttl,
+                       int count, double dt, double world_w, double min_y, double max_y) {
+    kvec vdt = kv_set1((sim_real)dt);
+    kvec vw = kv_set1((sim_real)world_w);
+    kvec vmin = kv_set1((sim_real)min_y);
+    kvec vmax = kv_set1((sim_real)max_y);
+    kvec zero = kv_zero();
+    int i;
+
+    for (i = 0; i + KERNEL_LANES <= count; i += KERNEL_LANES) {
+        kvec px = kv_add(kv_load(x + i), kv_mul(kv_load(vx + i), vdt));
+        kvec py = kv_add(kv_load(y + i), kv_mul(kv_load(vy + i), vdt));
+        kvec life = kv_sub(kv_load(ttl + i), vdt);
+        kvec outside = kv_or(kv_lt(py, vmin), kv_gt(py, vmax));
+
+        px = kv_add(px, kv_and(kv_lt(px, zero), vw));
+        px = kv_sub(px, kv_and(kv_ge(px, vw), vw));
+        kv_store(x + i, px);
+        kv_store(y + i, py);
+        kv_store(ttl + i, kv_andnot(outside, life));
+    }
+    advance_xy_scalar(x, y, vx, vy, ttl, i, count, (sim_real)dt, (sim_real)world_w,
+                      (sim_real)min_y, (sim_real)max_y);
+}
+
+const char *kernel_isa_name(void) {
+    return KERNEL_ISA;
+}
+
+#else
+
+void kernel_advance_x(sim_real *x, const sim_real *vx, sim_real *ttl, int count, double dt, double world_w) {
+    advance_x_scalar(x, vx, ttl, 0, count, (sim_real)dt, (sim_real)world_w);
+}
+
+void kernel_advance_xy(sim_real *x, sim_real *y, const sim_real *vx, const sim_real *vy, sim_real *ttl,
+                       int count, double dt, double world_w, double min_y, double max_y) {
+    advance_xy_scalar(x, y, vx, vy, ttl, 0, count, (sim_real)dt, (sim_real)world_w,
+                      (sim_real)min_y, (sim_real)max_y);
+}
+
+const char *kernel_isa_name(void) {
+    return "scalar";
+}
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include "game.h"
+
+/* Batch integration over packed projectile arrays. Positions are wrapped into
+ * [0, world_w) with a single correction, so |v * dt| must stay below world_w.
+ * Entries that expire get ttl <= 0 and are left for the caller to compact.
+ * All arithmetic is done in sim_real, so the SIMD and scalar paths agree bit for bit. */
+void kernel_advance_x(sim_real *x, const sim_real *vx, sim_real *ttl, int count, double dt, double world_w);
+void kernel_advance_xy(sim_real *x, sim_real *y, const sim_real *vx, const sim_real *vy, sim_real *ttl,
+                       int count, double dt, double world_w, double min_y, double max_y);
+
+const char *kernel_isa_name(void);
+
+#endif
@@ -1,35 +1,300 @@
-#define _POSIX_C_SOURCE 199309L
+#define _POSIX_C_SOURCE 200809L
 
 #include "game.h"
 #include "input.h"
+#include "monotonic.h"
+#include "pacer.h"
+#include "profiler.h"
 #include "render.h"
+#include "replay.h"
+#include "sim.h"
+#include "spectate.h"
 
+#include <errno.h>
 #include <ncurses.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
 #include <time.h>
+#include <unistd.h>
 
 #define SIM_HZ 60.0
+#define MIN_SIM_HZ 10.0
 #define FRAME_HZ 60.0
-#define SIM_DT (1.0 / SIM_HZ)
+/* Frames between overlay percentile updates. */
+#define PROFILE_STATS_INTERVAL 15
+/* Events copied out of the sim's ring per drain call. */
+#define EVENT_DRAIN_BATCH 64
 
-static double min_double(double a, double b) {
-    return a < b ? a : b;
+static volatile sig_atomic_t g_resized;
+
+/* Installed before initscr() so ncurses leaves SIGWINCH to us: it would only notice a
+ * resize inside getch(), which the render loop no longer calls. */
+static void on_resize(int signal_number) {
+    (void)signal_number;
+    g_resized = 1;
+}
+
+static void apply_resize(void) {
+    struct winsize size;
+
+    g_resized = 0;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0 && size.ws_row > 0 && size.ws_col > 0) {
+        resizeterm(size.ws_row, size.ws_col);
+    }
 }
 
-static double monotonic_seconds(void) {
-    struct timespec now;
+typedef struct {
+    const char *record_path;
+    const char *replay_path;
+    const char *profile_csv_path;
+    const char *broadcast_path;
+    const char *spectate_path;
+    long seek_step;
+    int stress_scale;
+    double sim_hz;
+    RenderBackend backend;
+    int legacy_keys;
+    /* When the host can't keep up: drop frames and keep game time (0), or slow the game. */
+    int pace_slow;
+} Options;
+
+static int parse_options(int argc, char **argv, Options *options) {
+    int i;
+
+    memset(options, 0, sizeof(*options));
+    options->seek_step = -1;
+    options->sim_hz = SIM_HZ;
+    options->backend = RENDER_BACKEND_ANSI;
+
+    for (i = 1; i < argc; ++i) {
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+
+        if (strcmp(argv[i], "--record") == 0 && value) {
+            options->record_path = value;
+            ++i;
+        } else if (strcmp(argv[i], "--replay") == 0 && value) {
+            options->replay_path = value;
+            ++i;
+        } else if (strcmp(argv[i], "--profile-csv") == 0 && value) {
+            options->profile_csv_path = value;
+            ++i;
+        } else if (strcmp(argv[i], "--broadcast") == 0 && value) {
+            options->broadcast_path = value;
+            ++i;
+        } else if (strcmp(argv[i], "--spectate") == 0 && value) {
+            options->spectate_path = value;
+            ++i;
+        } else if (strcmp(argv[i], "--seek") == 0 && value) {
+            options->seek_step = strtol(value, NULL, 10);
+            ++i;
+        } else if (strcmp(argv[i], "--sim-hz") == 0 && value) {
+            options->sim_hz = strtod(value, NULL);
+            if (options->sim_hz < MIN_SIM_HZ) return 0;
+            ++i;
+        } else if (strcmp(argv[i], "--backend") == 0 && value) {
+            if (strcmp(value, "ansi") == 0) options->backend = RENDER_BACKEND_ANSI;
+            else if (strcmp(value, "curses") == 0) options->backend = RENDER_BACKEND_CURSES;
+            else return 0;
+            ++i;
+        } else if (strcmp(argv[i], "--pace") == 0 && value) {
+            if (strcmp(value, "drop") == 0) options->pace_slow = 0;
+            else if (strcmp(value, "slow") == 0) options->pace_slow = 1;
+            else return 0;
+            ++i;
+        } else if (strcmp(argv[i], "--legacy-keys") == 0) {
+            options->legacy_keys = 1;
+        } else if (strcmp(argv[i], "--stress") == 0 && value) {
+            options->stress_scale = atoi(value);
+            if (options->stress_scale < 1) return 0;
+            ++i;
+        } else {
+            return 0;
+        }
+    }
+    return 1;
+}
 
-    clock_gettime(CLOCK_MONOTONIC, &now);
-    return now.tv_sec + now.tv_nsec / 1e9;
+static void print_state_summary(const GameState *game, long step) {
+    printf("step %ld: wave %d score %d lives %d enemies %d humans %d%s\n",
+           step, game->wave_number, game->player.score, game->player.lives,
+           game_active_enemy_count(game), game_active_human_count(game),
+           game->game_over ? " (game over)" : "");
 }
 
-int main(void) {
+static int run_replay(const Options *options) {
+    ReplayReader reader;
     GameState game;
-    InputContext input_context;
-    double last_seconds;
-    double accumulator = 0.0;
+    double start;
+    double seconds;
+    long steps = 0;
+
+    if (!replay_open(&reader, options->replay_path, &game)) {
+        fprintf(stderr, "could not read replay %s\n", options->replay_path);
+        return 1;
+    }
+
+    start = monotonic_seconds();
+    if (options->seek_step >= 0) {
+        if (!replay_seek(&reader, &game, options->seek_step)) {
+            fprintf(stderr, "step %ld is outside the replay (0..%ld)\n", options->seek_step, reader.total_steps);
+            replay_close(&reader);
+            game_destroy(&game);
+            return 1;
+        }
+        seconds = monotonic_seconds() - start;
+        printf("seeked to step %ld in %.3f ms\n", reader.step, seconds * 1e3);
+    } else {
+        while (replay_step(&reader, &game)) steps++;
+        seconds = monotonic_seconds() - start;
+        printf("replayed %ld steps in %.3f s (%.0f steps/sec)\n",
+               steps, seconds, seconds > 0.0 ? steps / seconds : 0.0);
+    }
+    print_state_summary(&game, reader.step);
+    replay_close(&reader);
+    game_destroy(&game);
+    return 0;
+}
+
+/* Watches a game started with --broadcast, drawn at this terminal's size. Only the newest
+ * state is drawn when several arrive between redraws. */
+static int run_spectate(const Options *options) {
+    SpectateViewer viewer;
+    int quit = 0;
+    int shown = 0;
+    int status = 0;
 
-    srand((unsigned)time(NULL));
+    if (!spectate_viewer_open(&viewer, options->spectate_path)) {
+        fprintf(stderr, "could not connect to %s\n", options->spectate_path);
+        return 1;
+    }
+
+    initscr();
+    cbreak();
+    noecho();
+    keypad(stdscr, TRUE);
+    nodelay(stdscr, TRUE);
+    curs_set(0);
+    render_init_graphics();
+    clear();
+    mvprintw(5, 5, "Spectating %s - Q to quit", options->spectate_path);
+    refresh();
+    if (!render_set_backend(options->backend, STDOUT_FILENO)) render_set_backend(RENDER_BACKEND_CURSES, STDOUT_FILENO);
+
+    while (!quit && status >= 0) {
+        struct pollfd fds[2];
+        int redraw = 0;
+        int key;
+
+        fds[0].fd = viewer.fd;
+        fds[0].events = POLLIN;
+        fds[1].fd = STDIN_FILENO;
+        fds[1].events = POLLIN;
+        if (poll(fds, 2, -1) < 0 && errno != EINTR) break;
+
+        /* ncurses handles SIGWINCH here and reports it as KEY_RESIZE. */
+        while ((key = getch()) != ERR) {
+            if (key == 'q' || key == 'Q') quit = 1;
+            else if (key == KEY_RESIZE) redraw = 1;
+        }
+        status = spectate_viewer_poll(&viewer);
+        if (status > 0) shown = 1;
+        if (shown && (status > 0 || redraw)) {
+            int term_h;
+            int term_w;
+
+            getmaxyx(stdscr, term_h, term_w);
+            render_game(&viewer.game, NULL, 1.0, term_w, term_h);
+            render_present();
+        }
+    }
+
+    endwin();
+    printf("watched %ld records (%ld keyframes) up to step %ld%s\n", viewer.records, viewer.keyframes, viewer.step,
+           status < 0 ? "; the broadcast ended" : "");
+    spectate_viewer_close(&viewer);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    Options options;
+    SimThread *sim;
+    InputThread input;
+    struct sigaction resize_action;
+    ReplayWriter recorder;
+    SpectateServer *broadcast = NULL;
+    GameLimits limits;
+    Profiler profiler;
+    ProfileStats profile_stats;
+    GamePhaseTimes seen_phases;
+    Pacer frame_pacer;
+    long seen_steps = 0;
+    long broadcast_steps = -1;
+    int show_profiler = 0;
+    int seen_toggles = 0;
+    int key_release;
+    int status = 0;
+    double sim_dt;
+
+    if (!parse_options(argc, argv, &options)) {
+        fprintf(stderr, "usage: %s [--stress SCALE] [--sim-hz HZ] [--backend ansi|curses] [--profile-csv FILE]\n"
+                        "       %*s [--pace drop|slow] [--legacy-keys] [--record FILE] [--broadcast SOCKET]\n"
+                        "       %s --replay FILE [--seek STEP]\n"
+                        "       %s --spectate SOCKET [--backend ansi|curses]\n",
+                argv[0], (int)strlen(argv[0]), "", argv[0], argv[0]);
+        return 2;
+    }
+    if (options.replay_path) return run_replay(&options);
+    if (options.spectate_path) return run_spectate(&options);
+    sim_dt = 1.0 / options.sim_hz;
+
+    if (options.stress_scale > 0) game_stress_limits(&limits, options.stress_scale);
+    else game_default_limits(&limits);
+    sim = malloc(sizeof(*sim));
+    if (!sim || !sim_init(sim, &limits, (uint64_t)time(NULL), sim_dt)) {
+        fprintf(stderr, "could not allocate a game for those limits\n");
+        free(sim);
+        return 1;
+    }
+    profiler_init(&profiler);
+    memset(&profile_stats, 0, sizeof(profile_stats));
+    memset(&seen_phases, 0, sizeof(seen_phases));
+    if (options.profile_csv_path && !profiler_open_csv(&profiler, options.profile_csv_path)) {
+        fprintf(stderr, "could not open %s for profiling\n", options.profile_csv_path);
+        sim_destroy(sim);
+        free(sim);
+        return 1;
+    }
+    memset(&recorder, 0, sizeof(recorder));
+    if (options.record_path &&
+        !replay_writer_open(&recorder, options.record_path, &sim->game, sim_dt, REPLAY_DEFAULT_KEYFRAME_INTERVAL)) {
+        fprintf(stderr, "could not open %s for recording\n", options.record_path);
+        profiler_close(&profiler);
+        sim_destroy(sim);
+        free(sim);
+        return 1;
+    }
+    if (options.broadcast_path) {
+        broadcast = malloc(sizeof(*broadcast));
+        if (!broadcast || !spectate_server_start(broadcast, options.broadcast_path, &limits)) {
+            fprintf(stderr, "could not listen for spectators on %s\n", options.broadcast_path);
+            free(broadcast);
+            replay_writer_close(&recorder);
+            profiler_close(&profiler);
+            sim_destroy(sim);
+            free(sim);
+            return 1;
+        }
+    }
+
+    memset(&resize_action, 0, sizeof(resize_action));
+    resize_action.sa_handler = on_resize;
+    sigemptyset(&resize_action.sa_mask);
+    resize_action.sa_flags = SA_RESTART;
+    sigaction(SIGWINCH, &resize_action, NULL);
 
     initscr();
     cbreak();
@@ -41,62 +306,136 @@ int main(void) {
 
     clear();
     mvprintw(5, 5, "DEFENDER - terminal demo");
-    mvprintw(7, 5, "Controls: Arrow keys to thrust, Space to fire, B to use bomb, R to restart, Q to quit");
+    mvprintw(7, 5, "Controls: Arrow keys to thrust, Space to fire, B to use bomb, R to restart, Q to quit, P for profiler");
     mvprintw(9, 5, "Goal: Stop abductions, catch falling humans, and bring them back to the ground.");
     mvprintw(11, 5, "Press any key to start...");
     refresh();
     nodelay(stdscr, FALSE);
     getch();
     nodelay(stdscr, TRUE);
+    /* Terminals without cursor addressing stay on ncurses. */
+    if (!render_set_backend(options.backend, STDOUT_FILENO)) render_set_backend(RENDER_BACKEND_CURSES, STDOUT_FILENO);
 
-    game_init(&game);
-    input_init(&input_context);
-    last_seconds = monotonic_seconds();
+    if (!sim_start(sim, &recorder, options.pace_slow ? PACER_SLIP : PACER_CATCH_UP)) {
+        endwin();
+        fprintf(stderr, "could not start the simulation thread\n");
+        if (broadcast) spectate_server_stop(broadcast);
+        free(broadcast);
+        replay_writer_close(&recorder);
+        profiler_close(&profiler);
+        sim_destroy(sim);
+        free(sim);
+        return 1;
+    }
+    key_release = options.legacy_keys ? 0 : input_enable_key_release(STDIN_FILENO, STDOUT_FILENO);
+    if (!input_thread_start(&input, sim, STDIN_FILENO, key_release)) {
+        if (key_release) input_disable_key_release(STDOUT_FILENO);
+        endwin();
+        fprintf(stderr, "could not start the input thread\n");
+        sim_stop(sim);
+        if (broadcast) spectate_server_stop(broadcast);
+        free(broadcast);
+        replay_writer_close(&recorder);
+        profiler_close(&profiler);
+        sim_destroy(sim);
+        free(sim);
+        return 1;
+    }
 
+    /* This thread only draws; keys are read on the input thread and game_step() runs on
+     * the sim thread. A late frame is dropped, so the next one still lands on a 1/FRAME_HZ
+     * boundary, unless --pace slow asked for every frame to be drawn. */
+    pacer_init(&frame_pacer, 1.0 / FRAME_HZ, 0.0, options.pace_slow ? PACER_SLIP : PACER_SKIP, monotonic_seconds());
     while (1) {
-        InputState input;
-        double now_seconds = monotonic_seconds();
-        double frame_dt = now_seconds - last_seconds;
-
-        last_seconds = now_seconds;
-        if (frame_dt > 0.25) frame_dt = 0.25;
-
-        input_poll(&input_context, &input, now_seconds);
-        if (input.quit) break;
-        if (input.restart) {
-            game_init(&game);
-            input_init(&input_context);
-        }
+        GamePhaseTimes phase_times;
+        const SimFrame *frame;
+        double now_seconds;
+        double key_stamp;
+        double alpha;
+        int toggles;
+        int phase;
+
+        pacer_wait(&frame_pacer);
+        now_seconds = monotonic_seconds();
+        profiler_begin_frame(&profiler);
+        if (input_quit_requested(&input)) break;
+        toggles = input_profiler_toggles(&input);
+        if ((toggles - seen_toggles) & 1) show_profiler = !show_profiler;
+        seen_toggles = toggles;
+        if (g_resized) apply_resize();
+        profiler_mark(&profiler, PROFILE_INPUT);
 
-        accumulator += frame_dt;
-        while (accumulator >= SIM_DT) {
-            game_step(&game, SIM_DT, &input);
-            input.fire = 0;
-            input.bomb = 0;
-            input.restart = 0;
-            accumulator -= SIM_DT;
+        frame = sim_latest_frame(sim);
+        {
+            GameEvent events[EVENT_DRAIN_BATCH];
+            int count;
+            int e;
+
+            do {
+                count = event_ring_drain(&sim->events, events, EVENT_DRAIN_BATCH);
+                for (e = 0; e < count; ++e) render_note_event(&events[e]);
+            } while (count == EVENT_DRAIN_BATCH);
         }
+        for (phase = 0; phase < GAME_PHASE_COUNT; ++phase) {
+            phase_times.ns[phase] = frame->phases_total.ns[phase] - seen_phases.ns[phase];
+        }
+        profiler_add_steps(&profiler, &phase_times, (int)(frame->steps_total - seen_steps));
+        seen_phases = frame->phases_total;
+        seen_steps = frame->steps_total;
+
+        alpha = (now_seconds - frame->step_due) / sim_dt;
+        if (alpha < 0.0) alpha = 0.0;
+        if (alpha > 1.0) alpha = 1.0;
 
         {
             int term_h;
             int term_w;
 
             getmaxyx(stdscr, term_h, term_w);
-            render_game(&game, term_w, term_h);
+            render_game(&frame->game, &frame->history, alpha, term_w, term_h);
+            if (show_profiler) {
+                if (profiler.frames % PROFILE_STATS_INTERVAL == 0) profiler_stats(&profiler, &profile_stats);
+                render_profiler_overlay(&profile_stats, term_w, term_h);
+            }
+            render_present();
         }
+        profiler_mark(&profiler, PROFILE_RENDER);
+        /* Spectators get each new step the render loop sees, after the local frame is out. */
+        if (broadcast && frame->steps_total != broadcast_steps) {
+            spectate_offer(broadcast, &frame->game, frame->steps_total);
+            broadcast_steps = frame->steps_total;
+        }
+        {
+            double shown = monotonic_seconds();
 
-        if (accumulator < SIM_DT) {
-            struct timespec sleep_for;
-            double remain = (1.0 / FRAME_HZ) - accumulator;
-
-            if (remain > 0.0) {
-                sleep_for.tv_sec = 0;
-                sleep_for.tv_nsec = (long)(min_double(remain, 1.0 / FRAME_HZ) * 1e9);
-                nanosleep(&sleep_for, NULL);
+            while (input_next_shown_key(&input, frame->inputs_taken, &key_stamp)) {
+                profiler_add_key_latency(&profiler, (long long)((shown - key_stamp) * 1e9));
             }
         }
+        profiler_end_frame(&profiler);
     }
 
+    input_thread_stop(&input);
+    if (key_release) input_disable_key_release(STDOUT_FILENO);
     endwin();
-    return 0;
+    sim_stop(sim);
+    if (!replay_writer_close(&recorder)) {
+        fprintf(stderr, "error writing replay %s; the recording is incomplete\n", options.record_path);
+        status = 1;
+    }
+    if (broadcast) {
+        spectate_server_stop(broadcast);
+        spectate_print_stats(broadcast, stdout);
+        free(broadcast);
+    }
+    pacer_print(&frame_pacer, "frames", stdout);
+    pacer_print(&sim->pacer, "sim steps", stdout);
+    if (event_ring_dropped(&sim->events) > 0) {
+        printf("events: %u dropped; some HUD messages were missed\n", event_ring_dropped(&sim->events));
+    }
+    profiler_print_key_latency(&profiler, stdout);
+    profiler_close(&profiler);
+    sim_destroy(sim);
+    free(sim);
+    return status;
 }
@@ -0,0 +1,19 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "monotonic.h"
+
+#include <time.h>
+
+double monotonic_seconds(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+long long monotonic_ns(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
@@ -0,0 +1,9 @@
+#ifndef MONOTONIC_H
+#define MONOTONIC_H
+
+/* CLOCK_MONOTONIC readings: seconds for pacing and wall-clock rates, nanoseconds for the
+ * per-phase profilers that sum many short intervals. Both read the same clock. */
+double monotonic_seconds(void);
+long long monotonic_ns(void);
+
+#endif
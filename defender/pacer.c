@@ -0,0 +1,112 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "pacer.h"
+#include "monotonic.h"
+
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+#include <time.h>
+
+void pacer_sleep_until(double deadline) {
+    struct timespec when;
+
+    when.tv_sec = (time_t)deadline;
+    when.tv_nsec = (long)((deadline - (double)when.tv_sec) * 1e9);
+    if (when.tv_nsec >= 1000000000L) {
+        when.tv_sec++;
+        when.tv_nsec -= 1000000000L;
+    }
+    /* Only a signal is worth retrying; anything else (EINVAL) would just fail again. */
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &when, NULL) == EINTR) {
+    }
+}
+
+void pacer_init(Pacer *pacer, double period, double max_lag, PacerMode mode, double start) {
+    memset(pacer, 0, sizeof(*pacer));
+    pacer->mode = mode;
+    pacer->period = period;
+    pacer->max_lag = max_lag;
+    pacer->deadline = start;
+    pacer->last_wake = -1.0;
+}
+
+static void record_interval(Pacer *pacer, double now) {
+    double interval;
+    long bucket;
+
+    if (pacer->last_wake >= 0.0) {
+        interval = now - pacer->last_wake;
+        bucket = (long)(interval / PACER_BUCKET_SECONDS);
+        if (bucket >= PACER_BUCKETS) bucket = PACER_BUCKETS - 1;
+        if (bucket < 0) bucket = 0;
+        pacer->intervals[bucket]++;
+        if (interval > pacer->max_interval) pacer->max_interval = interval;
+    }
+    pacer->last_wake = now;
+}
+
+double pacer_wait(Pacer *pacer) {
+    double now = monotonic_seconds();
+    double due;
+
+    if (now < pacer->deadline || pacer->ticks == 0) {
+        pacer_sleep_until(pacer->deadline);
+        now = monotonic_seconds();
+    } else {
+        double late = now - pacer->deadline;
+        double behind;
+
+        pacer->missed++;
+        switch (pacer->mode) {
+            case PACER_CATCH_UP:
+                if (late > pacer->max_lag) {
+                    pacer->skipped += (long)(late / pacer->period);
+                    pacer->deadline = now;
+                }
+                break;
+            case PACER_SKIP:
+                behind = floor(late / pacer->period) + 1.0;
+                pacer->skipped += (long)behind;
+                pacer->deadline += behind * pacer->period;
+                pacer_sleep_until(pacer->deadline);
+                now = monotonic_seconds();
+                break;
+            case PACER_SLIP:
+                pacer->slipped_seconds += late;
+                pacer->deadline = now;
+                break;
+        }
+    }
+
+    record_interval(pacer, now);
+    pacer->ticks++;
+    due = pacer->deadline;
+    pacer->deadline += pacer->period;
+    return due;
+}
+
+double pacer_interval_percentile(const Pacer *pacer, double fraction) {
+    long total = pacer->ticks - 1;
+    long target;
+    long seen = 0;
+    int bucket;
+
+    if (total <= 0) return 0.0;
+    target = (long)(fraction * (total - 1));
+    for (bucket = 0; bucket < PACER_BUCKETS - 1; ++bucket) {
+        seen += pacer->intervals[bucket];
+        if (seen > target) break;
+    }
+    if ((bucket + 1) * PACER_BUCKET_SECONDS > pacer->max_interval) return pacer->max_interval;
+    return (bucket + 1) * PACER_BUCKET_SECONDS;
+}
+
+void pacer_print(const Pacer *pacer, const char *name, FILE *file) {
+    if (pacer->ticks < 2) return;
+    fprintf(file, "%s: %ld ticks at %.1f ms, %ld missed, %ld skipped, %.1f ms slipped;"
+                  " interval p50 %.2f p99 %.2f max %.2f ms\n",
+            name, pacer->ticks, pacer->period * 1e3, pacer->missed, pacer->skipped,
+            pacer->slipped_seconds * 1e3, pacer_interval_percentile(pacer, 0.50) * 1e3,
+            pacer_interval_percentile(pacer, 0.99) * 1e3, pacer->max_interval * 1e3);
+}
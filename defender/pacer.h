@@ -0,0 +1,49 @@
+#ifndef PACER_H
+#define PACER_H
+
+#include <stdio.h>
+
+/* Tick-to-tick intervals are histogrammed in 0.25 ms buckets, the last one open-ended. */
+#define PACER_BUCKETS 256
+#define PACER_BUCKET_SECONDS 0.00025
+
+/* What a pacer does with a tick whose deadline has already passed. */
+typedef enum {
+    /* Run it now, and any further late ticks back to back, so the schedule keeps wall-clock
+     * time; ticks more than max_lag behind are skipped instead. */
+    PACER_CATCH_UP = 0,
+    /* Skip to the next deadline still ahead. */
+    PACER_SKIP,
+    /* Run it now and move the whole schedule back by the overrun. */
+    PACER_SLIP
+} PacerMode;
+
+/* Sleeps to absolute CLOCK_MONOTONIC deadlines a fixed period apart, so the time spent
+ * between waits never shifts the schedule, and keeps account of what was late. */
+typedef struct {
+    PacerMode mode;
+    double period;
+    double max_lag;
+    double deadline;
+    double last_wake;
+    long ticks;
+    /* Ticks whose deadline had passed by the time pacer_wait() was called. */
+    long missed;
+    /* Ticks given up to get back on schedule. */
+    long skipped;
+    double slipped_seconds;
+    long intervals[PACER_BUCKETS];
+    double max_interval;
+} Pacer;
+
+void pacer_sleep_until(double deadline);
+
+/* The first tick is due at start. */
+void pacer_init(Pacer *pacer, double period, double max_lag, PacerMode mode, double start);
+/* Waits for the next tick and returns the time it was due. */
+double pacer_wait(Pacer *pacer);
+/* Upper edge of the interval bucket holding the given fraction of ticks, in seconds. */
+double pacer_interval_percentile(const Pacer *pacer, double fraction);
+void pacer_print(const Pacer *pacer, const char *name, FILE *file);
+
+#endif
@@ -0,0 +1,208 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "profiler.h"
+#include "monotonic.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define PROFILE_WRITER_PERIOD_NS 20000000L
+
+const char *profiler_slot_name(ProfileSlot slot) {
+    if (slot == PROFILE_INPUT) return "input";
+    if (slot >= PROFILE_PHASES && slot < PROFILE_RENDER) return game_phase_name((GamePhase)(slot - PROFILE_PHASES));
+    if (slot == PROFILE_RENDER) return "render";
+    if (slot == PROFILE_FRAME) return "frame";
+    return "unknown";
+}
+
+void profiler_init(Profiler *profiler) {
+    memset(profiler, 0, sizeof(*profiler));
+    atomic_init(&profiler->ring_head, 0);
+    atomic_init(&profiler->ring_tail, 0);
+    atomic_init(&profiler->dropped, 0);
+    atomic_init(&profiler->writer_stop, 0);
+}
+
+static void write_csv_row(FILE *file, const ProfileSample *sample) {
+    int slot;
+
+    fprintf(file, "%lld,%d", sample->frame, sample->steps);
+    for (slot = 0; slot < PROFILE_SLOT_COUNT; ++slot) {
+        fprintf(file, ",%lld", sample->ns[slot]);
+    }
+    fprintf(file, ",%lld\n", sample->key_latency_ns);
+}
+
+static void drain_ring(Profiler *profiler) {
+    unsigned long tail = atomic_load_explicit(&profiler->ring_tail, memory_order_relaxed);
+    unsigned long head = atomic_load_explicit(&profiler->ring_head, memory_order_acquire);
+
+    while (tail != head) {
+        write_csv_row(profiler->csv, &profiler->ring[tail & (PROFILE_RING_SIZE - 1)]);
+        ++tail;
+        atomic_store_explicit(&profiler->ring_tail, tail, memory_order_release);
+    }
+}
+
+static void *csv_writer_main(void *arg) {
+    Profiler *profiler = arg;
+    struct timespec period = {0, PROFILE_WRITER_PERIOD_NS};
+
+    while (!atomic_load_explicit(&profiler->writer_stop, memory_order_acquire)) {
+        drain_ring(profiler);
+        nanosleep(&period, NULL);
+    }
+    drain_ring(profiler);
+    return NULL;
+}
+
+int profiler_open_csv(Profiler *profiler, const char *path) {
+    int slot;
+
+    profiler->ring = malloc(sizeof(*profiler->ring) * PROFILE_RING_SIZE);
+    profiler->csv = fopen(path, "w");
+    if (!profiler->ring || !profiler->csv) {
+        profiler_close(profiler);
+        return 0;
+    }
+
+    fprintf(profiler->csv, "frame,steps");
+    for (slot = 0; slot < PROFILE_SLOT_COUNT; ++slot) {
+        fprintf(profiler->csv, ",%s_ns", profiler_slot_name((ProfileSlot)slot));
+    }
+    fprintf(profiler->csv, ",key_latency_ns\n");
+
+    if (pthread_create(&profiler->writer, NULL, csv_writer_main, profiler) != 0) {
+        profiler_close(profiler);
+        return 0;
+    }
+    return 1;
+}
+
+void profiler_close(Profiler *profiler) {
+    if (profiler->csv && profiler->ring) {
+        atomic_store_explicit(&profiler->writer_stop, 1, memory_order_release);
+        pthread_join(profiler->writer, NULL);
+    }
+    if (profiler->csv) fclose(profiler->csv);
+    free(profiler->ring);
+    profiler->csv = NULL;
+    profiler->ring = NULL;
+}
+
+void profiler_begin_frame(Profiler *profiler) {
+    memset(&profiler->current, 0, sizeof(profiler->current));
+    profiler->current.frame = profiler->frames;
+    profiler->frame_start_ns = monotonic_ns();
+    profiler->mark_ns = profiler->frame_start_ns;
+}
+
+void profiler_mark(Profiler *profiler, ProfileSlot slot) {
+    long long now_ns = monotonic_ns();
+
+    profiler->current.ns[slot] += now_ns - profiler->mark_ns;
+    profiler->mark_ns = now_ns;
+}
+
+void profiler_add_steps(Profiler *profiler, const GamePhaseTimes *times, int steps) {
+    int phase;
+
+    for (phase = 0; phase < GAME_PHASE_COUNT; ++phase) {
+        profiler->current.ns[PROFILE_PHASES + phase] += times->ns[phase];
+    }
+    profiler->current.steps += steps;
+    profiler->mark_ns = monotonic_ns();
+}
+
+void profiler_add_key_latency(Profiler *profiler, long long ns) {
+    long long bucket = ns / PROFILE_LATENCY_BUCKET_NS;
+
+    if (ns < 0) return;
+    if (bucket >= PROFILE_LATENCY_BUCKETS) bucket = PROFILE_LATENCY_BUCKETS - 1;
+    profiler->latency_counts[bucket]++;
+    profiler->latency_keys++;
+    if (ns > profiler->latency_max_ns) profiler->latency_max_ns = ns;
+    if (ns > profiler->current.key_latency_ns) profiler->current.key_latency_ns = ns;
+}
+
+/* Never blocks the game loop: if the writer is a full ring behind, the frame is dropped. */
+static void push_ring(Profiler *profiler, const ProfileSample *sample) {
+    unsigned long head = atomic_load_explicit(&profiler->ring_head, memory_order_relaxed);
+    unsigned long tail = atomic_load_explicit(&profiler->ring_tail, memory_order_acquire);
+
+    if (head - tail >= PROFILE_RING_SIZE) {
+        atomic_fetch_add_explicit(&profiler->dropped, 1, memory_order_relaxed);
+        return;
+    }
+    profiler->ring[head & (PROFILE_RING_SIZE - 1)] = *sample;
+    atomic_store_explicit(&profiler->ring_head, head + 1, memory_order_release);
+}
+
+void profiler_end_frame(Profiler *profiler) {
+    profiler->current.ns[PROFILE_FRAME] = monotonic_ns() - profiler->frame_start_ns;
+
+    profiler->history[profiler->history_next] = profiler->current;
+    profiler->history_next = (profiler->history_next + 1) % PROFILE_WINDOW;
+    if (profiler->history_count < PROFILE_WINDOW) profiler->history_count++;
+    if (profiler->ring) push_ring(profiler, &profiler->current);
+    profiler->frames++;
+}
+
+static int compare_ns(const void *a, const void *b) {
+    long long lhs = *(const long long *)a;
+    long long rhs = *(const long long *)b;
+
+    return (lhs > rhs) - (lhs < rhs);
+}
+
+/* Upper edge of the bucket holding the given fraction of keys, in ms. */
+static double latency_percentile_ms(const Profiler *profiler, double fraction) {
+    long target = (long)(fraction * (profiler->latency_keys - 1));
+    long seen = 0;
+    int bucket;
+
+    for (bucket = 0; bucket < PROFILE_LATENCY_BUCKETS - 1; ++bucket) {
+        seen += profiler->latency_counts[bucket];
+        if (seen > target) break;
+    }
+    if ((bucket + 1) * PROFILE_LATENCY_BUCKET_NS > profiler->latency_max_ns) return profiler->latency_max_ns / 1e6;
+    return (bucket + 1) * PROFILE_LATENCY_BUCKET_NS / 1e6;
+}
+
+void profiler_stats(const Profiler *profiler, ProfileStats *stats) {
+    long long values[PROFILE_WINDOW];
+    int count = profiler->history_count;
+    int slot;
+    int i;
+
+    memset(stats, 0, sizeof(*stats));
+    stats->samples = count;
+    stats->dropped = atomic_load_explicit(&profiler->dropped, memory_order_relaxed);
+    stats->keys = profiler->latency_keys;
+    if (profiler->latency_keys > 0) {
+        stats->key_p50_ms = latency_percentile_ms(profiler, 0.50);
+        stats->key_p99_ms = latency_percentile_ms(profiler, 0.99);
+    }
+    if (count == 0) return;
+
+    for (slot = 0; slot < PROFILE_SLOT_COUNT; ++slot) {
+        for (i = 0; i < count; ++i) values[i] = profiler->history[i].ns[slot];
+        qsort(values, (size_t)count, sizeof(values[0]), compare_ns);
+        stats->p50_us[slot] = values[(count - 1) * 50 / 100] / 1e3;
+        stats->p99_us[slot] = values[(count - 1) * 99 / 100] / 1e3;
+    }
+}
+
+void profiler_print_key_latency(const Profiler *profiler, FILE *file) {
+    static const double fractions[] = {0.50, 0.90, 0.99};
+    int i;
+
+    if (profiler->latency_keys == 0) return;
+    fprintf(file, "key-to-frame latency over %ld keys:", profiler->latency_keys);
+    for (i = 0; i < (int)(sizeof(fractions) / sizeof(fractions[0])); ++i) {
+        fprintf(file, " p%.0f %.1f ms", fractions[i] * 100, latency_percentile_ms(profiler, fractions[i]));
+    }
+    fprintf(file, " max %.1f ms\n", profiler->latency_max_ns / 1e6);
+}
@@ -0,0 +1,87 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include "game.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+
+/* Rolling window for the overlay's percentiles, in frames. */
+#define PROFILE_WINDOW 240
+/* Frames the CSV writer thread may fall behind before samples are dropped; a power of two. */
+#define PROFILE_RING_SIZE 1024
+/* Key-to-frame latency histogram: 0.1 ms buckets, the last one open-ended. */
+#define PROFILE_LATENCY_BUCKETS 1000
+#define PROFILE_LATENCY_BUCKET_NS 100000LL
+
+/* Per-frame timing slots: input, one per game phase, render, and the whole frame
+ * (everything but the pacing sleep). */
+typedef enum {
+    PROFILE_INPUT = 0,
+    PROFILE_PHASES,
+    PROFILE_RENDER = PROFILE_PHASES + GAME_PHASE_COUNT,
+    PROFILE_FRAME,
+    PROFILE_SLOT_COUNT
+} ProfileSlot;
+
+typedef struct {
+    long long frame;
+    int steps;
+    long long ns[PROFILE_SLOT_COUNT];
+    /* Slowest key this frame was the first to show, 0 if none. */
+    long long key_latency_ns;
+} ProfileSample;
+
+typedef struct {
+    int samples;
+    long dropped;
+    double p50_us[PROFILE_SLOT_COUNT];
+    double p99_us[PROFILE_SLOT_COUNT];
+    long keys;
+    double key_p50_ms;
+    double key_p99_ms;
+} ProfileStats;
+
+typedef struct {
+    ProfileSample current;
+    long long frame_start_ns;
+    long long mark_ns;
+    long long frames;
+    ProfileSample history[PROFILE_WINDOW];
+    int history_count;
+    int history_next;
+    long latency_counts[PROFILE_LATENCY_BUCKETS];
+    long latency_keys;
+    long long latency_max_ns;
+
+    /* Single-producer (the game loop) single-consumer (the CSV writer) ring. */
+    ProfileSample *ring;
+    atomic_ulong ring_head;
+    atomic_ulong ring_tail;
+    atomic_long dropped;
+    FILE *csv;
+    pthread_t writer;
+    atomic_int writer_stop;
+} Profiler;
+
+void profiler_init(Profiler *profiler);
+/* Starts a thread that streams every frame's sample to path as CSV. */
+int profiler_open_csv(Profiler *profiler, const char *path);
+void profiler_close(Profiler *profiler);
+
+void profiler_begin_frame(Profiler *profiler);
+/* Charges the time since the previous mark to slot. */
+void profiler_mark(Profiler *profiler, ProfileSlot slot);
+/* Adds the phase times of this frame's game_step_timed() calls and restarts the mark. */
+void profiler_add_steps(Profiler *profiler, const GamePhaseTimes *times, int steps);
+/* Records the time from a key press to the end of the frame that first showed it. */
+void profiler_add_key_latency(Profiler *profiler, long long ns);
+void profiler_end_frame(Profiler *profiler);
+
+void profiler_stats(const Profiler *profiler, ProfileStats *stats);
+/* Writes the session's key-to-frame latency distribution. */
+void profiler_print_key_latency(const Profiler *profiler, FILE *file);
+const char *profiler_slot_name(ProfileSlot slot);
+
+#endif
@@ -1,29 +1,218 @@
 #include "render.h"
+#include "ansi.h"
 
 #include <math.h>
 #include <ncurses.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TERRAIN_SPAN_CHUNK 256
+/* Anything that moved further than this in one step (respawns, reused enemy slots) is
+ * drawn where it is rather than swept across the screen. */
+#define INTERP_SNAP_DISTANCE 12.0
+/* Event messages under the radar, and score popups where they were earned, last this many
+ * game steps (about 2.5 s and 0.75 s at the default 60 Hz). */
+#define NOTE_LINES 2
+#define NOTE_STEPS 150
+#define POPUP_COUNT 8
+#define POPUP_STEPS 45
+
+typedef enum {
+    LAYER_TERRAIN = 0,
+    LAYER_ENTITIES,
+    LAYER_HUD,
+    LAYER_COUNT
+} RenderLayer;
+
+/* ch == 0 is a transparent cell; the layer below shows through. */
+typedef struct {
+    unsigned char ch;
+    unsigned char pair;
+} Cell;
+
+/* Frames are drawn into these layers and composited in render_present(), which only sends
+ * the cells that differ from what the terminal already shows (front). The terrain layer
+ * survives between frames and is scrolled when the camera moves. Rows nothing was drawn
+ * into this frame or the last, and that the terrain did not change, are not compared. */
+typedef struct {
+    int w;
+    int h;
+    Cell *layers[LAYER_COUNT];
+    Cell *front;
+    char *span;
+    /* Bit 0: the entity or HUD layer has cells in the row this frame; bit 1: it had last frame. */
+    unsigned char *row_marks;
+    int *terrain_top;
+    int terrain_first_row;
+    /* Topmost row the terrain has covered or uncovered since the last flush. */
+    int terrain_dirty_row;
+    int terrain_valid;
+    int terrain_visible;
+    int flushed_terrain_visible;
+    int force_flush;
+    long terrain_first_x;
+    /* Columns draw_block() may fill: GAME_VIEW_MAX_HALF_W either side of the player, so a
+     * terminal wider than that never shows the enemies game.c updates at a reduced rate. */
+    int entity_left;
+    int entity_right;
+} Framebuffer;
 
 static int g_use256_colors = 0;
+static Framebuffer g_fb;
+static RenderFlushMode g_flush_mode = RENDER_FLUSH_CELLS;
+static RenderBackend g_backend = RENDER_BACKEND_CURSES;
+static AnsiEncoder g_ansi;
+/* Newest first. */
+static GameEvent g_notes[NOTE_LINES];
+static int g_note_count;
+static GameEvent g_popups[POPUP_COUNT];
+static int g_popup_count;
+static int g_popup_next;
+static int g_ansi_fd = -1;
+
+static void free_framebuffer(void) {
+    int layer;
+
+    for (layer = 0; layer < LAYER_COUNT; ++layer) free(g_fb.layers[layer]);
+    free(g_fb.front);
+    free(g_fb.span);
+    free(g_fb.row_marks);
+    free(g_fb.terrain_top);
+    memset(&g_fb, 0, sizeof(g_fb));
+}
+
+static int resize_framebuffer(int w, int h) {
+    size_t count = (size_t)w * (size_t)h;
+    int layer;
+
+    if (g_fb.front && g_fb.w == w && g_fb.h == h) return 1;
+
+    free_framebuffer();
+    for (layer = 0; layer < LAYER_COUNT; ++layer) {
+        g_fb.layers[layer] = calloc(count, sizeof(Cell));
+        if (!g_fb.layers[layer]) {
+            free_framebuffer();
+            return 0;
+        }
+    }
+    g_fb.front = malloc(count * sizeof(Cell));
+    g_fb.span = malloc((size_t)w);
+    g_fb.row_marks = calloc((size_t)h, 1);
+    g_fb.terrain_top = calloc((size_t)w, sizeof(int));
+    if (!g_fb.front || !g_fb.span || !g_fb.row_marks || !g_fb.terrain_top) {
+        free_framebuffer();
+        return 0;
+    }
+    /* 0xff never occurs in a layer, so every cell is sent on the first flush. */
+    memset(g_fb.front, 0xff, count * sizeof(Cell));
+    g_fb.w = w;
+    g_fb.h = h;
+    g_fb.force_flush = 1;
+    g_fb.terrain_first_row = h;
+    g_fb.terrain_dirty_row = h;
+    if (g_backend == RENDER_BACKEND_ANSI) ansi_set_size(&g_ansi, w, h);
+    else clear();
+    return 1;
+}
+
+static void put_cell(RenderLayer layer, int x, int y, int ch, int pair) {
+    Cell *cell;
 
-static void draw_block(int sx, int sy, int w, int h, int pair, int screen_w, int screen_h) {
+    if (x < 0 || y < 0 || x >= g_fb.w || y >= g_fb.h) return;
+    cell = &g_fb.layers[layer][y * g_fb.w + x];
+    g_fb.row_marks[y] |= 1;
+    cell->ch = (unsigned char)ch;
+    cell->pair = (unsigned char)pair;
+}
+
+static void layer_print(RenderLayer layer, int y, int x, int pair, const char *format, ...) {
+    char text[256];
+    va_list args;
+    int i;
+
+    va_start(args, format);
+    vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    for (i = 0; text[i]; ++i) put_cell(layer, x + i, y, (unsigned char)text[i], pair);
+}
+
+static void draw_block(int sx, int sy, int w, int h, int pair) {
     int yy;
     int xx;
 
-    if (sx >= screen_w || sy >= screen_h || sx + w <= 0 || sy + h <= 0) return;
-
-    attron(COLOR_PAIR(pair));
     for (yy = 0; yy < h; ++yy) {
-        int py = sy + yy;
-
-        if (py < 0 || py >= screen_h) continue;
         for (xx = 0; xx < w; ++xx) {
-            int px = sx + xx;
+            if (sx + xx < g_fb.entity_left || sx + xx > g_fb.entity_right) continue;
+            put_cell(LAYER_ENTITIES, sx + xx, sy + yy, ' ', pair);
+        }
+    }
+}
+
+static void fill_terrain_columns(double first_x, int from, int to) {
+    Cell *terrain = g_fb.layers[LAYER_TERRAIN];
+    double heights[TERRAIN_SPAN_CHUNK];
+    int column;
+
+    for (column = from; column < to; column += TERRAIN_SPAN_CHUNK) {
+        int span = to - column < TERRAIN_SPAN_CHUNK ? to - column : TERRAIN_SPAN_CHUNK;
+        int i;
+
+        game_terrain_span(first_x + column, 1.0, span, heights);
+        for (i = 0; i < span; ++i) {
+            int terrain_y = 1 + (int)lround(heights[i]);
+            int y;
+
+            g_fb.terrain_top[column + i] = terrain_y;
+            for (y = 0; y < g_fb.h; ++y) {
+                Cell *cell = &terrain[y * g_fb.w + column + i];
+                int ground = y >= terrain_y && y < g_fb.h - 1;
+
+                cell->ch = ground ? ' ' : 0;
+                cell->pair = ground ? 25 : 0;
+            }
+        }
+    }
+}
 
-            if (px < 0 || px >= screen_w) continue;
-            mvaddch(py, px, ' ');
+/* first_x is the whole world column at the left screen edge. Scrolling by fewer columns
+ * than the screen is wide moves the cached cells and samples only the exposed columns. */
+static void update_terrain(double first_x) {
+    long first = (long)first_x;
+    long shift = first - g_fb.terrain_first_x;
+    int w = g_fb.w;
+    int x;
+    int y;
+
+    if (shift > (long)WORLD_W / 2) shift -= (long)WORLD_W;
+    if (shift < -(long)WORLD_W / 2) shift += (long)WORLD_W;
+
+    if (g_fb.terrain_valid && shift == 0) return;
+    if (!g_fb.terrain_valid || shift >= w || -shift >= w) {
+        fill_terrain_columns(first_x, 0, w);
+    } else {
+        int keep = w - (int)(shift > 0 ? shift : -shift);
+
+        for (y = 0; y < g_fb.h; ++y) {
+            Cell *row = &g_fb.layers[LAYER_TERRAIN][y * w];
+
+            if (shift > 0) memmove(row, row + shift, sizeof(Cell) * (size_t)keep);
+            else memmove(row - shift, row, sizeof(Cell) * (size_t)keep);
         }
+        if (shift > 0) memmove(g_fb.terrain_top, g_fb.terrain_top + shift, sizeof(int) * (size_t)keep);
+        else memmove(g_fb.terrain_top - shift, g_fb.terrain_top, sizeof(int) * (size_t)keep);
+        if (shift > 0) fill_terrain_columns(first_x, keep, w);
+        else fill_terrain_columns(first_x, 0, w - keep);
+    }
+    g_fb.terrain_valid = 1;
+    g_fb.terrain_first_x = first;
+    if (g_fb.terrain_first_row < g_fb.terrain_dirty_row) g_fb.terrain_dirty_row = g_fb.terrain_first_row;
+    g_fb.terrain_first_row = g_fb.h;
+    for (x = 0; x < w; ++x) {
+        if (g_fb.terrain_top[x] < g_fb.terrain_first_row) g_fb.terrain_first_row = g_fb.terrain_top[x];
     }
-    attroff(COLOR_PAIR(pair));
+    if (g_fb.terrain_first_row < g_fb.terrain_dirty_row) g_fb.terrain_dirty_row = g_fb.terrain_first_row;
 }
 
 static void world_to_view(double wx, double wy, double center_x, int screen_center_x, int *sx, int *sy) {
@@ -31,6 +220,171 @@ static void world_to_view(double wx, double wy, double center_x, int screen_cent
     *sy = 1 + (int)lround(wy);
 }
 
+void render_note_event(const GameEvent *event) {
+    int i;
+
+    switch (event->type) {
+    case GAME_EVENT_WAVE_STARTED:
+        if (event->step == 0) {
+            g_note_count = 0;
+            g_popup_count = 0;
+        }
+        return;
+    case GAME_EVENT_ENEMY_KILLED:
+        break;
+    case GAME_EVENT_HUMAN_RESCUED:
+    case GAME_EVENT_PLAYER_HIT:
+    case GAME_EVENT_HUMAN_ABDUCTED:
+    case GAME_EVENT_HUMAN_LOST:
+    case GAME_EVENT_WAVE_CLEARED:
+        for (i = NOTE_LINES - 1; i > 0; --i) g_notes[i] = g_notes[i - 1];
+        g_notes[0] = *event;
+        if (g_note_count < NOTE_LINES) ++g_note_count;
+        break;
+    default:
+        return;
+    }
+    if (event->type == GAME_EVENT_ENEMY_KILLED || event->type == GAME_EVENT_HUMAN_RESCUED) {
+        g_popups[g_popup_next] = *event;
+        g_popup_next = (g_popup_next + 1) % POPUP_COUNT;
+        if (g_popup_count < POPUP_COUNT) ++g_popup_count;
+    }
+}
+
+/* Steps since the event, or -1 once it has expired. Events drained ahead of the frame's
+ * game state count as new. */
+static int event_age(const GameState *game, const GameEvent *event, int lifetime) {
+    int age = (int)(game->ai_tick - event->step);
+
+    if (age < 0) return 0;
+    return age < lifetime ? age : -1;
+}
+
+static void draw_notes(const GameState *game, double view_x, int screen_center_x) {
+    int i;
+    int row = 1;
+
+    for (i = 0; i < g_note_count; ++i) {
+        const GameEvent *note = &g_notes[i];
+
+        if (event_age(game, note, NOTE_STEPS) < 0) continue;
+        switch (note->type) {
+        case GAME_EVENT_PLAYER_HIT:
+            layer_print(LAYER_HUD, row++, 0, 27, "Ship lost (%s), %d left", game_loss_name((GameLoss)note->subject),
+                        note->value);
+            break;
+        case GAME_EVENT_HUMAN_ABDUCTED:
+            layer_print(LAYER_HUD, row++, 0, 27, "Human abducted!");
+            break;
+        case GAME_EVENT_HUMAN_LOST:
+            layer_print(LAYER_HUD, row++, 0, 27, note->value ? "Human carried off" : "Human fell to its death");
+            break;
+        case GAME_EVENT_HUMAN_RESCUED:
+            layer_print(LAYER_HUD, row++, 0, 27, "Human rescued +%d", note->value);
+            break;
+        case GAME_EVENT_WAVE_CLEARED:
+            layer_print(LAYER_HUD, row++, 0, 27, "Wave %d cleared +%d", note->subject, note->value);
+            break;
+        default:
+            break;
+        }
+    }
+    for (i = 0; i < g_popup_count; ++i) {
+        const GameEvent *popup = &g_popups[i];
+        int age = event_age(game, popup, POPUP_STEPS);
+        int sx;
+        int sy;
+
+        if (age < 0) continue;
+        /* Drifts up a row every third of its life. */
+        world_to_view(popup->x, popup->y - 1.0 - age * 3 / POPUP_STEPS, view_x, screen_center_x, &sx, &sy);
+        if (sx - 1 < g_fb.entity_left || sx + 2 > g_fb.entity_right || sy < 1 || sy >= (int)GROUND_Y) continue;
+        layer_print(LAYER_HUD, sy, sx - 1, 27, "+%d", popup->value);
+    }
+}
+
+int render_history_init(RenderHistory *history, const GameState *game) {
+    memset(history, 0, sizeof(*history));
+    history->capacity = game->limits.max_enemies;
+    history->enemy_x = calloc((size_t)history->capacity, sizeof(double));
+    history->enemy_y = calloc((size_t)history->capacity, sizeof(double));
+    history->enemy_capture = calloc((size_t)history->capacity, sizeof(unsigned));
+    history->enemy_spawn = calloc((size_t)history->capacity, sizeof(unsigned));
+    if (!history->enemy_x || !history->enemy_y || !history->enemy_capture || !history->enemy_spawn) {
+        render_history_free(history);
+        return 0;
+    }
+    return 1;
+}
+
+void render_history_free(RenderHistory *history) {
+    free(history->enemy_x);
+    free(history->enemy_y);
+    free(history->enemy_capture);
+    free(history->enemy_spawn);
+    memset(history, 0, sizeof(*history));
+}
+
+void render_history_copy(RenderHistory *dst, const RenderHistory *src) {
+    double *enemy_x = dst->enemy_x;
+    double *enemy_y = dst->enemy_y;
+    unsigned *enemy_capture = dst->enemy_capture;
+    unsigned *enemy_spawn = dst->enemy_spawn;
+
+    *dst = *src;
+    dst->enemy_x = enemy_x;
+    dst->enemy_y = enemy_y;
+    dst->enemy_capture = enemy_capture;
+    dst->enemy_spawn = enemy_spawn;
+    memcpy(dst->enemy_x, src->enemy_x, sizeof(double) * (size_t)src->capacity);
+    memcpy(dst->enemy_y, src->enemy_y, sizeof(double) * (size_t)src->capacity);
+    memcpy(dst->enemy_capture, src->enemy_capture, sizeof(unsigned) * (size_t)src->capacity);
+    memcpy(dst->enemy_spawn, src->enemy_spawn, sizeof(unsigned) * (size_t)src->capacity);
+}
+
+void render_history_capture(RenderHistory *history, const GameState *game, double dt) {
+    int i;
+    int n;
+
+    /* 0 marks a slot never captured; on wraparound forget every stamp rather than reuse one. */
+    if (++history->capture == 0) {
+        memset(history->enemy_capture, 0, sizeof(unsigned) * (size_t)history->capacity);
+        history->capture = 1;
+    }
+    history->valid = 1;
+    history->dt = dt;
+    history->player_x = game->player.x;
+    history->player_y = game->player.y;
+    for (i = 0; i < MAX_HUMANS; ++i) {
+        history->human_x[i] = game->humans[i].x;
+        history->human_y[i] = game->humans[i].y;
+    }
+    for (n = 0; n < game_active_enemy_count(game); ++n) {
+        int slot = game_enemy_slot(game, n);
+
+        history->enemy_x[slot] = game_enemy_x(game, slot);
+        history->enemy_y[slot] = game_enemy_y(game, slot);
+        history->enemy_capture[slot] = history->capture;
+        history->enemy_spawn[slot] = game_enemy_spawn_id(game, slot);
+    }
+}
+
+/* Blends from (prev_x, prev_y) to (x, y) across the world seam; the result may lie outside
+ * [0, WORLD_W), which world_to_view() handles. */
+static void blend_position(double prev_x, double prev_y, double x, double y, double alpha,
+                           double *out_x, double *out_y) {
+    double dx = game_wrapped_dx(prev_x, x);
+    double dy = y - prev_y;
+
+    if (!(dx * dx + dy * dy <= INTERP_SNAP_DISTANCE * INTERP_SNAP_DISTANCE)) {
+        *out_x = x;
+        *out_y = y;
+        return;
+    }
+    *out_x = prev_x + dx * alpha;
+    *out_y = prev_y + dy * alpha;
+}
+
 void render_init_graphics(void) {
     if (!has_colors()) return;
 
@@ -47,38 +401,55 @@ void render_init_graphics(void) {
     init_pair(27, COLOR_WHITE, -1);
 }
 
-void render_game(const GameState *game, int term_w, int term_h) {
+void render_game(const GameState *game, const RenderHistory *history, double alpha, int term_w, int term_h) {
     int i;
+    int n;
     int radar_origin = 7;
     int radar_width = term_w - radar_origin;
     int screen_center_x = term_w / 2;
+    int interpolate = history && history->valid;
+    /* Shots fly in straight lines, so their earlier position comes from their velocity. */
+    double shot_rewind = interpolate ? (1.0 - alpha) * history->dt : 0.0;
+    double view_x = game->player.x;
+    double view_y = game->player.y;
+
+    if (term_w <= 0 || term_h <= 0 || !resize_framebuffer(term_w, term_h)) return;
+    for (i = 0; i < term_h; ++i) {
+        if (g_fb.row_marks[i] & 1) {
+            memset(&g_fb.layers[LAYER_ENTITIES][i * term_w], 0, sizeof(Cell) * (size_t)term_w);
+            memset(&g_fb.layers[LAYER_HUD][i * term_w], 0, sizeof(Cell) * (size_t)term_w);
+        }
+        g_fb.row_marks[i] = (unsigned char)((g_fb.row_marks[i] & 1) << 1);
+    }
+    g_fb.terrain_visible = 0;
 
-    erase();
+    if (interpolate) {
+        blend_position(history->player_x, history->player_y, game->player.x, game->player.y, alpha,
+                       &view_x, &view_y);
+    }
 
     if (term_w < MIN_TERM_W || term_h < MIN_TERM_H) {
-        mvprintw(1, 2, "Terminal too small.");
-        mvprintw(2, 2, "Need at least %dx%d, have %dx%d.", MIN_TERM_W, MIN_TERM_H, term_w, term_h);
-        mvprintw(4, 2, "Resize the terminal, then press R to restart or Q to quit.");
-        refresh();
+        layer_print(LAYER_HUD, 1, 2, 0, "Terminal too small.");
+        layer_print(LAYER_HUD, 2, 2, 0, "Need at least %dx%d, have %dx%d.", MIN_TERM_W, MIN_TERM_H, term_w, term_h);
+        layer_print(LAYER_HUD, 4, 2, 0, "Resize the terminal, then press R to restart or Q to quit.");
         return;
     }
 
-    mvprintw(0, 0, "Radar:");
+    layer_print(LAYER_HUD, 0, 0, 0, "Radar:");
     for (i = 0; i < radar_width; ++i) {
-        mvaddch(0, radar_origin + i, '-');
+        put_cell(LAYER_HUD, radar_origin + i, 0, '-', 0);
     }
 
-    for (i = 0; i < MAX_ENEMIES; ++i) {
-        if (game->enemies[i].active && radar_width > 0) {
-            int rx = (int)((game->enemies[i].x / WORLD_W) * (radar_width - 1));
+    for (n = 0; n < game_active_enemy_count(game) && radar_width > 0; ++n) {
+        int slot = game_enemy_slot(game, n);
+        int rx = (int)((game_enemy_x(game, slot) / WORLD_W) * (radar_width - 1));
 
-            if (rx >= 0 && rx < radar_width) {
-                int marker = 'E';
+        if (rx >= 0 && rx < radar_width) {
+            int marker = 'E';
 
-                if (game->enemies[i].type == E_MUTANT) marker = 'M';
-                else if (game->enemies[i].type == E_BOMBER) marker = 'B';
-                mvaddch(0, radar_origin + rx, marker);
-            }
+            if (game_enemy_type(game, slot) == E_MUTANT) marker = 'M';
+            else if (game_enemy_type(game, slot) == E_BOMBER) marker = 'B';
+            put_cell(LAYER_HUD, radar_origin + rx, 0, marker, 0);
         }
     }
 
@@ -86,23 +457,18 @@ void render_game(const GameState *game, int term_w, int term_h) {
         int px = (int)((game->player.x / WORLD_W) * (radar_width - 1));
 
         if (px >= 0 && px < radar_width) {
-            mvaddch(0, radar_origin + px, 'P');
+            put_cell(LAYER_HUD, radar_origin + px, 0, 'P', 0);
         }
     }
 
-    attron(COLOR_PAIR(25));
-    for (i = 0; i < term_w; ++i) {
-        int world_x = (int)game_wrap_x(game->player.x + (i - screen_center_x));
-        int terrain_y = 1 + (int)lround(game_terrain_y(world_x));
-        int y;
-
-        for (y = terrain_y; y < term_h - 1; ++y) {
-            mvaddch(y, i, ' ');
-        }
-    }
-    attroff(COLOR_PAIR(25));
+    update_terrain(floor(game_wrap_x(view_x - screen_center_x)));
+    g_fb.terrain_visible = 1;
+    g_fb.entity_left = screen_center_x - GAME_VIEW_MAX_HALF_W;
+    g_fb.entity_right = screen_center_x + GAME_VIEW_MAX_HALF_W;
 
     for (i = 0; i < MAX_HUMANS; ++i) {
+        double hx = game->humans[i].x;
+        double hy = game->humans[i].y;
         int sx;
         int sy;
         int pair;
@@ -113,42 +479,48 @@ void render_game(const GameState *game, int term_w, int term_h) {
             continue;
         }
 
-        world_to_view(game->humans[i].x, game->humans[i].y, game->player.x, screen_center_x, &sx, &sy);
+        if (interpolate) blend_position(history->human_x[i], history->human_y[i], hx, hy, alpha, &hx, &hy);
+        world_to_view(hx, hy, view_x, screen_center_x, &sx, &sy);
         pair = game->humans[i].state == H_FALLING ? 23 : 22;
-        draw_block(sx, sy, 1, 1, pair, term_w, term_h);
+        draw_block(sx, sy, 1, 1, pair);
     }
 
-    for (i = 0; i < MAX_ENEMIES; ++i) {
+    for (n = 0; n < game_active_enemy_count(game); ++n) {
+        int slot = game_enemy_slot(game, n);
+        EnemyType type = game_enemy_type(game, slot);
+        double ex = game_enemy_x(game, slot);
+        double ey = game_enemy_y(game, slot);
         int sx;
         int sy;
 
-        if (!game->enemies[i].active) continue;
-
-        world_to_view(game->enemies[i].x, game->enemies[i].y, game->player.x, screen_center_x, &sx, &sy);
+        /* A slot that was free at capture, or refilled since, holds someone else's position. */
+        if (interpolate && history->enemy_capture[slot] == history->capture &&
+            history->enemy_spawn[slot] == game_enemy_spawn_id(game, slot)) {
+            blend_position(history->enemy_x[slot], history->enemy_y[slot], ex, ey, alpha, &ex, &ey);
+        }
+        world_to_view(ex, ey, view_x, screen_center_x, &sx, &sy);
         draw_block(sx - 1, sy, 3, 1,
-                   game->enemies[i].type == E_MUTANT ? 24 :
-                   game->enemies[i].type == E_BOMBER ? 23 : 21,
-                   term_w, term_h);
+                   type == E_MUTANT ? 24 :
+                   type == E_BOMBER ? 23 : 21);
     }
 
-    for (i = 0; i < MAX_BULLETS; ++i) {
+    for (n = 0; n < game_bullet_count(game); ++n) {
         int sx;
         int sy;
 
-        if (!game->bullets[i].active) continue;
-
-        world_to_view(game->bullets[i].x, game->bullets[i].y, game->player.x, screen_center_x, &sx, &sy);
-        draw_block(sx, sy, 1, 1, 23, term_w, term_h);
+        world_to_view(game_bullet_x(game, n) - game->bullets.vx[n] * shot_rewind, game_bullet_y(game, n),
+                      view_x, screen_center_x, &sx, &sy);
+        draw_block(sx, sy, 1, 1, 23);
     }
 
-    for (i = 0; i < MAX_ENEMY_BULLETS; ++i) {
+    for (n = 0; n < game_enemy_bullet_count(game); ++n) {
         int sx;
         int sy;
 
-        if (!game->enemy_bullets[i].active) continue;
-
-        world_to_view(game->enemy_bullets[i].x, game->enemy_bullets[i].y, game->player.x, screen_center_x, &sx, &sy);
-        draw_block(sx, sy, 1, 1, 24, term_w, term_h);
+        world_to_view(game_enemy_bullet_x(game, n) - game->enemy_bullets.vx[n] * shot_rewind,
+                      game_enemy_bullet_y(game, n) - game->enemy_bullets.vy[n] * shot_rewind,
+                      view_x, screen_center_x, &sx, &sy);
+        draw_block(sx, sy, 1, 1, 24);
     }
 
     if (game->player.active &&
@@ -156,33 +528,231 @@ void render_game(const GameState *game, int term_w, int term_h) {
         int sx;
         int sy;
 
-        world_to_view(game->player.x, game->player.y, game->player.x, screen_center_x, &sx, &sy);
-        draw_block(sx - 1, sy, 3, 1, 20, term_w, term_h);
+        world_to_view(view_x, view_y, view_x, screen_center_x, &sx, &sy);
+        draw_block(sx - 1, sy, 3, 1, 20);
     }
 
-    attron(COLOR_PAIR(27));
-    mvprintw((int)GROUND_Y + 2, 0,
-             "Wave:%d  Score:%d  Next:%d  Bombs:%d  Lives:%d  Grounded:%d  Falling:%d  Lost:%d",
-             game->wave_number,
-             game->player.score,
-             game->next_extra_life_score,
-             game->player.bombs,
-             game->player.lives,
-             game_humans_in_state(game, H_GROUNDED),
-             game_humans_in_state(game, H_FALLING),
-             game_humans_in_state(game, H_LOST));
-    attroff(COLOR_PAIR(27));
+    layer_print(LAYER_HUD, (int)GROUND_Y + 2, 0, 27,
+                "Wave:%d  Score:%d  Next:%d  Bombs:%d  Lives:%d  Grounded:%d  Falling:%d  Lost:%d",
+                game->wave_number,
+                game->player.score,
+                game->next_extra_life_score,
+                game->player.bombs,
+                game->player.lives,
+                game_humans_in_state(game, H_GROUNDED),
+                game_humans_in_state(game, H_FALLING),
+                game_humans_in_state(game, H_LOST));
+    draw_notes(game, view_x, screen_center_x);
 
     if (game->wave_banner_timer > 0.0 && !game->game_over) {
-        mvprintw((int)GROUND_Y / 2, term_w / 2 - 6, "WAVE %d", game->wave_number);
+        layer_print(LAYER_HUD, (int)GROUND_Y / 2, term_w / 2 - 6, 0, "WAVE %d", game->wave_number);
     }
 
     if (game->game_over) {
-        mvprintw((int)GROUND_Y / 2, term_w / 2 - 8, "GAME OVER");
-        mvprintw((int)GROUND_Y / 2 + 1, term_w / 2 - 18, "Press R to restart or Q to quit");
+        layer_print(LAYER_HUD, (int)GROUND_Y / 2, term_w / 2 - 8, 0, "GAME OVER");
+        layer_print(LAYER_HUD, (int)GROUND_Y / 2 + 1, term_w / 2 - 18, 0, "Press R to restart or Q to quit");
     } else if (!game->player.active) {
-        mvprintw((int)GROUND_Y / 2, term_w / 2 - 7, "RESPAWNING");
+        layer_print(LAYER_HUD, (int)GROUND_Y / 2, term_w / 2 - 7, 0, "RESPAWNING");
+    }
+}
+
+void render_profiler_overlay(const ProfileStats *stats, int term_w, int term_h) {
+    int left = term_w - 32;
+    int row = 1;
+    int slot;
+
+    if (left < 0 || term_h < PROFILE_SLOT_COUNT + 5) return;
+
+    layer_print(LAYER_HUD, row++, left, 27, "%-14s %7s %7s  ", "frame (us)", "p50", "p99");
+    for (slot = 0; slot < PROFILE_SLOT_COUNT; ++slot) {
+        layer_print(LAYER_HUD, row++, left, 27, "%-14s %7.1f %7.1f  ", profiler_slot_name((ProfileSlot)slot),
+                    stats->p50_us[slot], stats->p99_us[slot]);
+    }
+    layer_print(LAYER_HUD, row++, left, 27, "%d frames, %ld dropped    ", stats->samples, stats->dropped);
+    layer_print(LAYER_HUD, row, left, 27, "key->frame ms %5.1f %7.1f  ", stats->key_p50_ms, stats->key_p99_ms);
+}
+
+static const Cell *composite_cell(int i) {
+    static const Cell blank = {' ', 0};
+    const Cell *cell = &g_fb.layers[LAYER_HUD][i];
+
+    if (!cell->ch) cell = &g_fb.layers[LAYER_ENTITIES][i];
+    if (!cell->ch && g_fb.terrain_visible) cell = &g_fb.layers[LAYER_TERRAIN][i];
+    if (!cell->ch) cell = &blank;
+    return cell;
+}
+
+static int cell_is_current(const Cell *cell, int i) {
+    return cell->ch == g_fb.front[i].ch && cell->pair == g_fb.front[i].pair;
+}
+
+static int row_needs_flush(int y) {
+    if (g_fb.force_flush || g_fb.row_marks[y]) return 1;
+    if (g_fb.terrain_visible != g_fb.flushed_terrain_visible) return 1;
+    return g_fb.terrain_visible && y >= g_fb.terrain_dirty_row;
+}
+
+static void flush_row_cells(int y) {
+    int row = y * g_fb.w;
+    int x;
+
+    for (x = 0; x < g_fb.w; ++x) {
+        const Cell *cell = composite_cell(row + x);
+
+        if (cell_is_current(cell, row + x)) continue;
+        mvaddch(y, x, cell->ch | COLOR_PAIR(cell->pair));
+        g_fb.front[row + x] = *cell;
+    }
+}
+
+/* Sends each run of changed cells that share a color pair with one call: mvhline() when
+ * the run is a single repeated character (block sprites, terrain, blank gaps), otherwise
+ * mvaddnstr(). */
+static void flush_row_spans(int y) {
+    int row = y * g_fb.w;
+    int x = 0;
+
+    while (x < g_fb.w) {
+        const Cell *cell = composite_cell(row + x);
+        int pair = cell->pair;
+        int repeated = 1;
+        int start = x;
+        int length = 0;
+
+        if (cell_is_current(cell, row + x)) {
+            ++x;
+            continue;
+        }
+        do {
+            g_fb.span[length] = (char)cell->ch;
+            if (cell->ch != (unsigned char)g_fb.span[0]) repeated = 0;
+            g_fb.front[row + x] = *cell;
+            ++length;
+            if (++x == g_fb.w) break;
+            cell = composite_cell(row + x);
+        } while (cell->pair == pair && !cell_is_current(cell, row + x));
+
+        if (length == 1) {
+            mvaddch(y, start, (unsigned char)g_fb.span[0] | COLOR_PAIR(pair));
+        } else if (repeated) {
+            mvhline(y, start, (unsigned char)g_fb.span[0] | COLOR_PAIR(pair), length);
+        } else {
+            attrset(COLOR_PAIR(pair));
+            mvaddnstr(y, start, g_fb.span, length);
+            attrset(A_NORMAL);
+        }
+    }
+}
+
+/* Literal gap: re-sending up to a few unchanged cells can be cheaper than a cursor move,
+ * provided they are all in the colors already set. */
+static void ansi_goto(int y, int x) {
+    int row = y * g_fb.w;
+    int from = g_ansi.cursor_x;
+    int gap = x - from;
+    int i;
+
+    if (g_ansi.cursor_y == y && from >= 0 && gap > 0 && gap < ansi_move_cost(&g_ansi, x, y)) {
+        for (i = from; i < x; ++i) {
+            if (!ansi_pair_is_current(&g_ansi, g_fb.front[row + i].pair)) break;
+            g_fb.span[i - from] = (char)g_fb.front[row + i].ch;
+        }
+        if (i == x) {
+            ansi_text(&g_ansi, g_fb.span, gap);
+            return;
+        }
+    }
+    ansi_move(&g_ansi, x, y);
+}
+
+/* Runs of identical changed cells go to the encoder, which picks literal bytes, REP or ECH.
+ * The bottom-right cell is never written, so no terminal scrolls. */
+static void flush_row_ansi(int y) {
+    int row = y * g_fb.w;
+    int end = y == g_fb.h - 1 ? g_fb.w - 1 : g_fb.w;
+    int x = 0;
+
+    while (x < end) {
+        const Cell *cell = composite_cell(row + x);
+        Cell first = *cell;
+        int start = x;
+
+        if (cell_is_current(cell, row + x)) {
+            ++x;
+            continue;
+        }
+        do {
+            g_fb.front[row + x] = *cell;
+            if (++x == end) break;
+            cell = composite_cell(row + x);
+        } while (cell->ch == first.ch && cell->pair == first.pair && !cell_is_current(cell, row + x));
+
+        ansi_goto(y, start);
+        ansi_use_pair(&g_ansi, first.pair);
+        ansi_repeat(&g_ansi, (char)first.ch, x - start);
     }
+}
 
+static int terminfo_has(const char *name) {
+    char *value = tigetstr((char *)name);
+
+    return value != NULL && value != (char *)-1;
+}
+
+int render_set_backend(RenderBackend backend, int fd) {
+    short pair;
+
+    if (g_backend == RENDER_BACKEND_ANSI) ansi_free(&g_ansi);
+    g_backend = RENDER_BACKEND_CURSES;
+    g_ansi_fd = -1;
+    free_framebuffer();
+    if (backend == RENDER_BACKEND_CURSES) return 1;
+    if (!terminfo_has("cup")) return 0;
+
+    ansi_init(&g_ansi, terminfo_has("rep"), terminfo_has("ech"), tigetflag((char *)"bce") > 0);
+    if (has_colors()) {
+        for (pair = 1; pair < ANSI_MAX_PAIRS && pair < COLOR_PAIRS; ++pair) {
+            short fg;
+            short bg;
+
+            if (pair_content(pair, &fg, &bg) == OK) ansi_set_pair(&g_ansi, pair, fg, bg);
+        }
+    }
+    /* Leave curses with a blank screen it has already drawn, so it never repaints over us. */
+    erase();
     refresh();
+    g_backend = RENDER_BACKEND_ANSI;
+    g_ansi_fd = fd;
+    return 1;
+}
+
+void render_set_flush_mode(RenderFlushMode mode) {
+    g_flush_mode = mode;
+}
+
+void render_present(void) {
+    int y;
+
+    if (!g_fb.front) return;
+
+    if (g_backend == RENDER_BACKEND_ANSI && g_fb.force_flush) {
+        static const Cell blank = {' ', 0};
+        int count = g_fb.w * g_fb.h;
+        int i;
+
+        ansi_clear_screen(&g_ansi);
+        for (i = 0; i < count; ++i) g_fb.front[i] = blank;
+    }
+
+    for (y = 0; y < g_fb.h; ++y) {
+        if (!row_needs_flush(y)) continue;
+        if (g_backend == RENDER_BACKEND_ANSI) flush_row_ansi(y);
+        else if (g_flush_mode == RENDER_FLUSH_CELLS) flush_row_cells(y);
+        else flush_row_spans(y);
+    }
+    g_fb.force_flush = 0;
+    g_fb.terrain_dirty_row = g_fb.h;
+    g_fb.flushed_terrain_visible = g_fb.terrain_visible;
+    if (g_backend == RENDER_BACKEND_ANSI) ansi_flush(&g_ansi, g_ansi_fd);
+    else refresh();
 }
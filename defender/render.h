@@ -2,8 +2,66 @@
 #define RENDER_H
 
 #include "game.h"
+#include "profiler.h"
+
+/* Positions from just before the latest game_step(), so frames that fall between two
+ * steps can be drawn part way between them. Enemies are kept per slot; a slot's position
+ * only counts if enemy_capture[slot] equals capture (it was live at the latest capture) and
+ * enemy_spawn[slot] still matches its spawn id (it was not killed and refilled in the step). */
+typedef struct {
+    int capacity;
+    int valid;
+    unsigned capture;
+    double dt;
+    double player_x;
+    double player_y;
+    double human_x[MAX_HUMANS];
+    double human_y[MAX_HUMANS];
+    double *enemy_x;
+    double *enemy_y;
+    unsigned *enemy_capture;
+    unsigned *enemy_spawn;
+} RenderHistory;
+
+int render_history_init(RenderHistory *history, const GameState *game);
+void render_history_free(RenderHistory *history);
+/* Both histories must have been set up for games with the same limits. */
+void render_history_copy(RenderHistory *dst, const RenderHistory *src);
+/* Call right before each game_step() of dt; after a restart, call it to drop stale motion. */
+void render_history_capture(RenderHistory *history, const GameState *game, double dt);
 
 void render_init_graphics(void);
-void render_game(const GameState *game, int term_w, int term_h);
+/* Draws into render.c's layered framebuffer; nothing reaches the terminal until
+ * render_present(), which sends only the cells that changed.
+ * alpha in [0, 1] is how far the frame is from history's step towards game; a NULL
+ * history draws game as is. */
+void render_game(const GameState *game, const RenderHistory *history, double alpha, int term_w, int term_h);
+/* Feed every event drained from the game's EventRing, in order. Kills and rescues show
+ * their points where they happened; hits, abductions, lost humans, rescues and cleared
+ * waves are listed under the radar for a few seconds. A game_init() clears them. */
+void render_note_event(const GameEvent *event);
+void render_profiler_overlay(const ProfileStats *stats, int term_w, int term_h);
+void render_present(void);
+
+/* How render_present() hands changed cells to ncurses. Per-cell mvaddch() is the default:
+ * runs are mostly one to three cells, where mvhline()/mvaddnstr() cost more per call than
+ * they save. Compare with `make render-bench`. */
+typedef enum {
+    RENDER_FLUSH_CELLS = 0,
+    RENDER_FLUSH_SPANS
+} RenderFlushMode;
+
+void render_set_flush_mode(RenderFlushMode mode);
+
+typedef enum {
+    RENDER_BACKEND_CURSES = 0,
+    /* Escape sequences written straight to a file descriptor with one write() per frame;
+     * curses still owns the terminal modes, input and terminfo. */
+    RENDER_BACKEND_ANSI
+} RenderBackend;
+
+/* Call after initscr()/newterm() and render_init_graphics(). Returns 0 and stays on curses
+ * if the terminal has no cursor addressing. */
+int render_set_backend(RenderBackend backend, int fd);
 
 #endif
@@ -0,0 +1,199 @@
+#define _POSIX_C_SOURCE 199309L
+
+#include "game.h"
+#include "render.h"
+
+#include <ncurses.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#define SIM_DT (1.0 / 60.0)
+
+/* Renders a scripted game into a virtual terminal backed by a temporary file, so frame cost
+ * and terminal output can be measured without a tty. */
+typedef struct {
+    long frames;
+    int width;
+    int height;
+    unsigned seed;
+    RenderFlushMode flush_mode;
+    RenderBackend backend;
+    GameLimits limits;
+    int enemies;
+} RenderBenchOptions;
+
+/* CPU time, so the figures hold up on a busy host. */
+static long long thread_cpu_ns(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return (long long)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+            "usage: %s [--frames N] [--size WxH] [--seed S] [--enemies N] [--stress SCALE]\n"
+            "          [--backend curses|ansi] [--flush cells|spans]\n",
+            argv0);
+}
+
+static int parse_options(int argc, char **argv, RenderBenchOptions *options) {
+    int i;
+
+    memset(options, 0, sizeof(*options));
+    options->frames = 3000;
+    options->width = 120;
+    options->height = 30;
+    options->seed = 1;
+    options->flush_mode = RENDER_FLUSH_CELLS;
+    options->enemies = 24;
+    game_default_limits(&options->limits);
+
+    for (i = 1; i < argc; ++i) {
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+
+        if (strcmp(argv[i], "--frames") == 0 && value) {
+            options->frames = strtol(value, NULL, 10);
+            ++i;
+        } else if (strcmp(argv[i], "--size") == 0 && value) {
+            if (sscanf(value, "%dx%d", &options->width, &options->height) != 2) return 0;
+            ++i;
+        } else if (strcmp(argv[i], "--seed") == 0 && value) {
+            options->seed = (unsigned)strtoul(value, NULL, 10);
+            ++i;
+        } else if (strcmp(argv[i], "--enemies") == 0 && value) {
+            options->enemies = atoi(value);
+            ++i;
+        } else if (strcmp(argv[i], "--stress") == 0 && value) {
+            if (atoi(value) < 1) return 0;
+            game_stress_limits(&options->limits, atoi(value));
+            ++i;
+        } else if (strcmp(argv[i], "--backend") == 0 && value) {
+            if (strcmp(value, "curses") == 0) options->backend = RENDER_BACKEND_CURSES;
+            else if (strcmp(value, "ansi") == 0) options->backend = RENDER_BACKEND_ANSI;
+            else return 0;
+            ++i;
+        } else if (strcmp(argv[i], "--flush") == 0 && value) {
+            if (strcmp(value, "spans") == 0) options->flush_mode = RENDER_FLUSH_SPANS;
+            else if (strcmp(value, "cells") == 0) options->flush_mode = RENDER_FLUSH_CELLS;
+            else return 0;
+            ++i;
+        } else {
+            return 0;
+        }
+    }
+    return options->frames > 0 && options->width >= MIN_TERM_W && options->height >= MIN_TERM_H;
+}
+
+/* The camera sweeps back and forth so the terrain layer keeps scrolling. */
+static void make_input(long frame, InputState *input) {
+    long phase = (frame / 240) % 2;
+
+    memset(input, 0, sizeof(*input));
+    input->right = phase == 0;
+    input->left = phase == 1;
+    input->up = (frame / 45) % 3 == 0;
+    input->down = (frame / 45) % 3 == 2;
+    input->fire = frame % 4 == 0;
+}
+
+static void top_up_enemies(GameState *game, int target) {
+    while (game_active_enemy_count(game) < target) {
+        EnemyType type = (EnemyType)(rand() % 3);
+        double x = (rand() % (int)WORLD_W);
+
+        if (!game_spawn_enemy(game, type, x, 3.0 + rand() % 8, rand() % 2 ? 1 : -1)) break;
+    }
+}
+
+int main(int argc, char **argv) {
+    RenderBenchOptions options;
+    GameState game;
+    FILE *terminal_out;
+    FILE *terminal_in;
+    SCREEN *screen;
+    const char *term = getenv("TERM");
+    struct stat info;
+    long long draw_ns = 0;
+    long long present_ns = 0;
+    long setup_bytes;
+    long bytes;
+    long frame;
+
+    if (!parse_options(argc, argv, &options)) {
+        usage(argv[0]);
+        return 2;
+    }
+    if (!game_create(&game, &options.limits)) {
+        fprintf(stderr, "could not allocate a game for those limits\n");
+        return 1;
+    }
+
+    terminal_out = tmpfile();
+    terminal_in = fopen("/dev/null", "r");
+    if (!terminal_out || !terminal_in) {
+        fprintf(stderr, "could not open the virtual terminal\n");
+        game_destroy(&game);
+        return 1;
+    }
+    screen = newterm(term && *term && strcmp(term, "dumb") != 0 ? term : "xterm-256color", terminal_out, terminal_in);
+    if (!screen) {
+        fprintf(stderr, "could not start ncurses on the virtual terminal\n");
+        game_destroy(&game);
+        return 1;
+    }
+    resizeterm(options.height, options.width);
+    curs_set(0);
+    render_init_graphics();
+    render_set_flush_mode(options.flush_mode);
+    if (!render_set_backend(options.backend, fileno(terminal_out))) {
+        endwin();
+        fprintf(stderr, "the terminal has no cursor addressing; use --backend curses\n");
+        game_destroy(&game);
+        return 1;
+    }
+    fflush(terminal_out);
+    fstat(fileno(terminal_out), &info);
+    setup_bytes = (long)info.st_size;
+
+    srand(options.seed);
+    game_init(&game, options.seed);
+    for (frame = 0; frame < options.frames; ++frame) {
+        InputState input;
+        long long start;
+        long long drawn;
+
+        make_input(frame, &input);
+        if (game.game_over) game_init(&game, game_seed_mix(game.seed));
+        top_up_enemies(&game, options.enemies);
+        game_step(&game, SIM_DT, &input);
+
+        start = thread_cpu_ns();
+        render_game(&game, NULL, 1.0, options.width, options.height);
+        drawn = thread_cpu_ns();
+        render_present();
+        present_ns += thread_cpu_ns() - drawn;
+        draw_ns += drawn - start;
+    }
+    fflush(terminal_out);
+    fstat(fileno(terminal_out), &info);
+    bytes = (long)info.st_size - setup_bytes;
+
+    endwin();
+    delscreen(screen);
+    fclose(terminal_out);
+    fclose(terminal_in);
+    game_destroy(&game);
+
+    printf("backend,size,frames,draw_ns,present_ns,bytes_per_frame\n");
+    printf("%s,%dx%d,%ld,%.1f,%.1f,%.1f\n",
+           options.backend == RENDER_BACKEND_ANSI ? "ansi" :
+           options.flush_mode == RENDER_FLUSH_CELLS ? "curses-cells" : "curses-spans",
+           options.width, options.height, options.frames,
+           (double)draw_ns / options.frames, (double)present_ns / options.frames,
+           (double)bytes / options.frames);
+    return 0;
+}
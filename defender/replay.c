@@ -0,0 +1,263 @@
+#include "replay.h"
+#include "snapshot.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define REPLAY_MAGIC "DFRP"
+#define REPLAY_VERSION 8
+
+/* Input bytes use the low six bits; anything with the top bit set is a record tag. */
+#define REC_KEYFRAME 0x80
+#define REC_RESTART 0x81
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t keyframe_interval;
+    /* sizeof(sim_real); float and double builds diverge, so they can't replay each other. */
+    uint32_t real_size;
+    GameLimits limits;
+    double dt;
+    uint64_t seed;
+} ReplayHeader;
+
+static unsigned char pack_input(const InputState *input) {
+    return (unsigned char)((input->left ? 0x01 : 0) |
+                           (input->right ? 0x02 : 0) |
+                           (input->up ? 0x04 : 0) |
+                           (input->down ? 0x08 : 0) |
+                           (input->fire ? 0x10 : 0) |
+                           (input->bomb ? 0x20 : 0));
+}
+
+static void unpack_input(unsigned char bits, InputState *input) {
+    memset(input, 0, sizeof(*input));
+    input->left = (bits & 0x01) != 0;
+    input->right = (bits & 0x02) != 0;
+    input->up = (bits & 0x04) != 0;
+    input->down = (bits & 0x08) != 0;
+    input->fire = (bits & 0x10) != 0;
+    input->bomb = (bits & 0x20) != 0;
+}
+
+static void write_bytes(ReplayWriter *writer, const void *data, size_t size) {
+    if (size > 0 && fwrite(data, size, 1, writer->file) != 1) writer->failed = 1;
+}
+
+static void write_byte(ReplayWriter *writer, int byte) {
+    if (fputc(byte, writer->file) == EOF) writer->failed = 1;
+}
+
+static void write_keyframe(ReplayWriter *writer, const GameState *game) {
+    int64_t step = writer->step;
+    uint32_t size = (uint32_t)game_snapshot_encode(game, writer->image, writer->image_capacity);
+
+    if (size == 0) writer->failed = 1;
+    write_byte(writer, REC_KEYFRAME);
+    write_bytes(writer, &step, sizeof(step));
+    write_bytes(writer, &size, sizeof(size));
+    write_bytes(writer, writer->image, size);
+    writer->last_keyframe_step = writer->step;
+}
+
+static int skip_keyframe_image(FILE *file) {
+    uint32_t size;
+
+    if (fread(&size, sizeof(size), 1, file) != 1) return 0;
+    return fseek(file, (long)size, SEEK_CUR) == 0;
+}
+
+int replay_writer_open(ReplayWriter *writer, const char *path, const GameState *game, double dt,
+                       int keyframe_interval) {
+    ReplayHeader header;
+
+    memset(writer, 0, sizeof(*writer));
+    writer->image_capacity = game_snapshot_max_size(game);
+    writer->image = malloc(writer->image_capacity);
+    if (!writer->image) return 0;
+    writer->file = fopen(path, "wb");
+    if (!writer->file) {
+        replay_writer_close(writer);
+        return 0;
+    }
+
+    writer->keyframe_interval = keyframe_interval > 0 ? keyframe_interval : REPLAY_DEFAULT_KEYFRAME_INTERVAL;
+    writer->last_keyframe_step = -1;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, REPLAY_MAGIC, sizeof(header.magic));
+    header.version = REPLAY_VERSION;
+    header.limits = game->limits;
+    header.keyframe_interval = (uint32_t)writer->keyframe_interval;
+    header.real_size = sizeof(sim_real);
+    header.dt = dt;
+    header.seed = game->seed;
+    write_bytes(writer, &header, sizeof(header));
+    return 1;
+}
+
+void replay_writer_step(ReplayWriter *writer, const GameState *game, const InputState *input) {
+    if (!writer->file) return;
+
+    if (writer->step % writer->keyframe_interval == 0 && writer->last_keyframe_step != writer->step) {
+        write_keyframe(writer, game);
+    }
+    write_byte(writer, pack_input(input));
+    writer->step++;
+}
+
+void replay_writer_restart(ReplayWriter *writer, const GameState *game) {
+    uint64_t seed = game->seed;
+
+    if (!writer->file) return;
+
+    write_byte(writer, REC_RESTART);
+    write_bytes(writer, &seed, sizeof(seed));
+    write_keyframe(writer, game);
+}
+
+int replay_writer_close(ReplayWriter *writer) {
+    int ok = !writer->failed;
+
+    if (writer->file) {
+        if (ferror(writer->file)) ok = 0;
+        if (fclose(writer->file) != 0) ok = 0;
+    }
+    free(writer->image);
+    memset(writer, 0, sizeof(*writer));
+    return ok;
+}
+
+static int index_records(ReplayReader *reader) {
+    int capacity = 0;
+    int ch;
+
+    while ((ch = fgetc(reader->file)) != EOF) {
+        if (ch == REC_KEYFRAME) {
+            int64_t step;
+
+            if (fread(&step, sizeof(step), 1, reader->file) != 1) return 0;
+            if (reader->keyframe_count == capacity) {
+                ReplayKeyframe *grown;
+
+                capacity = capacity ? capacity * 2 : 64;
+                grown = realloc(reader->keyframes, sizeof(*grown) * capacity);
+                if (!grown) return 0;
+                reader->keyframes = grown;
+            }
+            reader->keyframes[reader->keyframe_count].step = (long)step;
+            reader->keyframes[reader->keyframe_count].offset = ftell(reader->file);
+            reader->keyframe_count++;
+            if (!skip_keyframe_image(reader->file)) return 0;
+        } else if (ch == REC_RESTART) {
+            if (fseek(reader->file, (long)sizeof(uint64_t), SEEK_CUR) != 0) return 0;
+        } else {
+            reader->total_steps++;
+        }
+    }
+    return 1;
+}
+
+int replay_open(ReplayReader *reader, const char *path, GameState *game) {
+    ReplayHeader header;
+
+    memset(reader, 0, sizeof(*reader));
+    reader->file = fopen(path, "rb");
+    if (!reader->file) return 0;
+
+    if (fread(&header, sizeof(header), 1, reader->file) != 1 ||
+        memcmp(header.magic, REPLAY_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != REPLAY_VERSION ||
+        header.real_size != sizeof(sim_real) ||
+        !index_records(reader) ||
+        !game_create(game, &header.limits)) {
+        replay_close(reader);
+        return 0;
+    }
+
+    reader->image_capacity = game_snapshot_max_size(game);
+    reader->image = malloc(reader->image_capacity);
+    if (!reader->image) {
+        game_destroy(game);
+        replay_close(reader);
+        return 0;
+    }
+
+    reader->dt = header.dt;
+    reader->seed = header.seed;
+    reader->keyframe_interval = (int)header.keyframe_interval;
+    fseek(reader->file, (long)sizeof(header), SEEK_SET);
+    game_init(game, reader->seed);
+    return 1;
+}
+
+int replay_next_input(ReplayReader *reader, GameState *game, InputState *input) {
+    int ch;
+
+    while ((ch = fgetc(reader->file)) != EOF) {
+        if (ch == REC_KEYFRAME) {
+            fseek(reader->file, (long)sizeof(int64_t), SEEK_CUR);
+            if (!skip_keyframe_image(reader->file)) return 0;
+        } else if (ch == REC_RESTART) {
+            uint64_t seed;
+
+            if (fread(&seed, sizeof(seed), 1, reader->file) != 1) return 0;
+            game_init(game, seed);
+        } else {
+            unpack_input((unsigned char)ch, input);
+            reader->step++;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int replay_step(ReplayReader *reader, GameState *game) {
+    InputState input;
+
+    if (!replay_next_input(reader, game, &input)) return 0;
+    game_step(game, reader->dt, &input);
+    return 1;
+}
+
+int replay_seek(ReplayReader *reader, GameState *game, long step) {
+    int lo = 0;
+    int hi = reader->keyframe_count - 1;
+    int best = -1;
+    uint32_t size;
+
+    if (step < 0 || step > reader->total_steps) return 0;
+
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+
+        if (reader->keyframes[mid].step <= step) {
+            best = mid;
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    if (best < 0) return 0;
+
+    fseek(reader->file, reader->keyframes[best].offset, SEEK_SET);
+    if (fread(&size, sizeof(size), 1, reader->file) != 1 || size > reader->image_capacity ||
+        fread(reader->image, 1, size, reader->file) != size ||
+        !game_snapshot_decode(reader->image, size, game)) {
+        return 0;
+    }
+    reader->step = reader->keyframes[best].step;
+
+    while (reader->step < step) {
+        if (!replay_step(reader, game)) return 0;
+    }
+    return 1;
+}
+
+void replay_close(ReplayReader *reader) {
+    if (reader->file) fclose(reader->file);
+    free(reader->keyframes);
+    free(reader->image);
+    memset(reader, 0, sizeof(*reader));
+}
@@ -0,0 +1,64 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include "game.h"
+
+#include <stdio.h>
+
+#define REPLAY_DEFAULT_KEYFRAME_INTERVAL 600
+
+/* A replay is the game limits and seed, one byte of held/pressed keys per game_step(), and
+ * a snapshot-encoded GameState keyframe every keyframe_interval steps. Snapshots hold native
+ * doubles, so a file only replays on the architecture that wrote it. */
+typedef struct {
+    FILE *file;
+    long step;
+    long last_keyframe_step;
+    int keyframe_interval;
+    unsigned char *image;
+    size_t image_capacity;
+    /* Set once any write fails; the file is then incomplete and replay_writer_close() says so. */
+    int failed;
+} ReplayWriter;
+
+typedef struct {
+    long step;
+    long offset;
+} ReplayKeyframe;
+
+typedef struct {
+    FILE *file;
+    double dt;
+    uint64_t seed;
+    int keyframe_interval;
+    long total_steps;
+    long step;
+    ReplayKeyframe *keyframes;
+    int keyframe_count;
+    unsigned char *image;
+    size_t image_capacity;
+} ReplayReader;
+
+int replay_writer_open(ReplayWriter *writer, const char *path, const GameState *game, double dt,
+                       int keyframe_interval);
+/* Call once per game_step(), before stepping, with the state the step starts from. */
+void replay_writer_step(ReplayWriter *writer, const GameState *game, const InputState *input);
+/* Call after game_init() on a restart so the new seed and state are captured. */
+void replay_writer_restart(ReplayWriter *writer, const GameState *game);
+/* Returns 0 if anything failed to reach the file, including the final flush. */
+int replay_writer_close(ReplayWriter *writer);
+
+/* Opens a replay and indexes its keyframes. game is created with the recorded limits and
+ * left at step 0; the caller releases it with game_destroy() after replay_close(). */
+int replay_open(ReplayReader *reader, const char *path, GameState *game);
+/* Reads the input for the next step, applying any restart recorded before it, and counts
+ * the step as taken; the caller runs game_step(). Returns 0 at the end of the recording. */
+int replay_next_input(ReplayReader *reader, GameState *game, InputState *input);
+/* Applies the next recorded step to game. Returns 0 at the end of the recording. */
+int replay_step(ReplayReader *reader, GameState *game);
+/* Puts game into the state it had before step `step` ran, restoring the nearest
+ * earlier keyframe and re-simulating at most keyframe_interval steps. */
+int replay_seek(ReplayReader *reader, GameState *game, long step);
+void replay_close(ReplayReader *reader);
+
+#endif
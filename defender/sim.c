@@ -0,0 +1,150 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "sim.h"
+#include "monotonic.h"
+
+#include <string.h>
+
+#define SIM_FRESH 4
+#define SIM_INDEX_MASK 3
+/* Further behind than this (a suspended process, a debugger) and a catching-up sim skips
+ * the missed steps instead of running them as one burst. */
+#define SIM_MAX_LAG 0.25
+
+static void publish(SimThread *sim, double step_due) {
+    SimFrame *frame = &sim->frames[sim->back];
+
+    game_copy(&frame->game, &sim->game);
+    render_history_copy(&frame->history, &sim->history);
+    frame->step_due = step_due;
+    frame->steps_total = sim->steps_total;
+    frame->phases_total = sim->phases_total;
+    frame->inputs_taken = atomic_load_explicit(&sim->input_tail, memory_order_relaxed);
+
+    sim->back = atomic_exchange_explicit(&sim->shared, sim->back | SIM_FRESH, memory_order_acq_rel) & SIM_INDEX_MASK;
+}
+
+/* Folds everything queued since the last step into the input for this one. */
+static void take_input(SimThread *sim, InputState *input) {
+    unsigned tail = atomic_load_explicit(&sim->input_tail, memory_order_relaxed);
+    unsigned head = atomic_load_explicit(&sim->input_head, memory_order_acquire);
+
+    memset(input, 0, sizeof(*input));
+    while (tail != head) {
+        const InputState *queued = &sim->inputs[tail & (SIM_INPUT_QUEUE_SIZE - 1)];
+
+        sim->held = *queued;
+        input->fire |= queued->fire;
+        input->bomb |= queued->bomb;
+        input->restart |= queued->restart;
+        ++tail;
+    }
+    atomic_store_explicit(&sim->input_tail, tail, memory_order_release);
+
+    input->left = sim->held.left;
+    input->right = sim->held.right;
+    input->up = sim->held.up;
+    input->down = sim->held.down;
+}
+
+static void *sim_main(void *arg) {
+    SimThread *sim = arg;
+
+    pacer_init(&sim->pacer, sim->dt, SIM_MAX_LAG, sim->pace_mode, monotonic_seconds());
+    while (atomic_load_explicit(&sim->running, memory_order_acquire)) {
+        InputState input;
+        double due = pacer_wait(&sim->pacer);
+
+        take_input(sim, &input);
+        if (input.restart) {
+            game_init(&sim->game, game_seed_mix(sim->game.seed));
+            memset(&sim->held, 0, sizeof(sim->held));
+            if (sim->recorder) replay_writer_restart(sim->recorder, &sim->game);
+        }
+
+        if (sim->recorder) replay_writer_step(sim->recorder, &sim->game, &input);
+        render_history_capture(&sim->history, &sim->game, sim->dt);
+        game_step_timed(&sim->game, sim->dt, &input, &sim->phases_total);
+        sim->steps_total++;
+        publish(sim, due);
+    }
+    return NULL;
+}
+
+int sim_init(SimThread *sim, const GameLimits *limits, uint64_t seed, double dt) {
+    int i;
+
+    memset(sim, 0, sizeof(*sim));
+    sim->dt = dt;
+    if (!game_create(&sim->game, limits) || !render_history_init(&sim->history, &sim->game)) {
+        sim_destroy(sim);
+        return 0;
+    }
+    for (i = 0; i < 3; ++i) {
+        if (!game_create(&sim->frames[i].game, limits) ||
+            !render_history_init(&sim->frames[i].history, &sim->game)) {
+            sim_destroy(sim);
+            return 0;
+        }
+    }
+    event_ring_init(&sim->events);
+    game_set_event_ring(&sim->game, &sim->events);
+    game_init(&sim->game, seed);
+    render_history_capture(&sim->history, &sim->game, dt);
+
+    sim->back = 0;
+    sim->front = 1;
+    atomic_init(&sim->shared, 2);
+    atomic_init(&sim->input_head, 0);
+    atomic_init(&sim->input_tail, 0);
+    atomic_init(&sim->running, 0);
+    publish(sim, monotonic_seconds());
+    return 1;
+}
+
+int sim_start(SimThread *sim, ReplayWriter *recorder, PacerMode pace_mode) {
+    sim->recorder = recorder;
+    sim->pace_mode = pace_mode;
+    atomic_store_explicit(&sim->running, 1, memory_order_release);
+    if (pthread_create(&sim->thread, NULL, sim_main, sim) != 0) {
+        atomic_store_explicit(&sim->running, 0, memory_order_release);
+        return 0;
+    }
+    return 1;
+}
+
+void sim_stop(SimThread *sim) {
+    if (!atomic_load_explicit(&sim->running, memory_order_acquire)) return;
+
+    atomic_store_explicit(&sim->running, 0, memory_order_release);
+    pthread_join(sim->thread, NULL);
+}
+
+void sim_destroy(SimThread *sim) {
+    int i;
+
+    sim_stop(sim);
+    for (i = 0; i < 3; ++i) {
+        render_history_free(&sim->frames[i].history);
+        game_destroy(&sim->frames[i].game);
+    }
+    render_history_free(&sim->history);
+    game_destroy(&sim->game);
+}
+
+int sim_push_input(SimThread *sim, const InputState *input) {
+    unsigned head = atomic_load_explicit(&sim->input_head, memory_order_relaxed);
+    unsigned tail = atomic_load_explicit(&sim->input_tail, memory_order_acquire);
+
+    if (head - tail >= SIM_INPUT_QUEUE_SIZE) return 0;
+    sim->inputs[head & (SIM_INPUT_QUEUE_SIZE - 1)] = *input;
+    atomic_store_explicit(&sim->input_head, head + 1, memory_order_release);
+    return 1;
+}
+
+const SimFrame *sim_latest_frame(SimThread *sim) {
+    if (atomic_load_explicit(&sim->shared, memory_order_acquire) & SIM_FRESH) {
+        sim->front = atomic_exchange_explicit(&sim->shared, sim->front, memory_order_acq_rel) & SIM_INDEX_MASK;
+    }
+    return &sim->frames[sim->front];
+}
@@ -0,0 +1,75 @@
+#ifndef SIM_H
+#define SIM_H
+
+#include "game.h"
+#include "pacer.h"
+#include "render.h"
+#include "replay.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+/* Inputs the input thread may queue ahead of the sim thread; a power of two. */
+#define SIM_INPUT_QUEUE_SIZE 64
+
+/* What the sim thread hands to the render thread after every step. */
+typedef struct {
+    GameState game;
+    RenderHistory history;
+    /* Monotonic time at which this step was scheduled to run. */
+    double step_due;
+    /* Running totals, so a reader that skips frames can still account for every step. */
+    long steps_total;
+    GamePhaseTimes phases_total;
+    /* sim_push_input() calls this step has seen, for matching keys to the frame showing them. */
+    unsigned inputs_taken;
+} SimFrame;
+
+/* Runs game_step() on its own thread at a fixed rate, paced against absolute deadlines so
+ * nothing the render thread does (a blocking refresh(), a slow terminal) shifts the schedule.
+ * Frames go out through a lock-free triple buffer and inputs come in through an SPSC ring. */
+typedef struct {
+    GameState game;
+    ReplayWriter *recorder;
+    double dt;
+    PacerMode pace_mode;
+    /* Owned by the sim thread; read it after sim_stop(). */
+    Pacer pacer;
+    RenderHistory history;
+    InputState held;
+    long steps_total;
+    GamePhaseTimes phases_total;
+
+    SimFrame frames[3];
+    int back;
+    int front;
+    atomic_int shared;
+
+    /* game_step() emits here on the sim thread; the render thread drains it. */
+    EventRing events;
+
+    InputState inputs[SIM_INPUT_QUEUE_SIZE];
+    atomic_uint input_head;
+    atomic_uint input_tail;
+
+    atomic_int running;
+    pthread_t thread;
+} SimThread;
+
+/* Creates the game and its frame buffers and runs game_init(seed); the thread is not started,
+ * so the caller may still set things up against sim->game (e.g. replay_writer_open()). */
+int sim_init(SimThread *sim, const GameLimits *limits, uint64_t seed, double dt);
+/* recorder may be NULL. pace_mode says what to do with late steps: PACER_CATCH_UP keeps
+ * game time in step with the wall clock, PACER_SLIP lets the game slow down instead.
+ * From here on sim->game belongs to the sim thread. */
+int sim_start(SimThread *sim, ReplayWriter *recorder, PacerMode pace_mode);
+void sim_stop(SimThread *sim);
+void sim_destroy(SimThread *sim);
+
+/* Input thread: queues a change of input. Directions are taken from the latest queued
+ * input; fire, bomb and restart fire once if any queued input has them. */
+int sim_push_input(SimThread *sim, const InputState *input);
+/* Render thread: the newest published frame, valid until the next call. */
+const SimFrame *sim_latest_frame(SimThread *sim);
+
+#endif
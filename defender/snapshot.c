@@ -0,0 +1,663 @@
+#include "snapshot.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    unsigned char *data;
+    size_t size;
+    size_t capacity;
+    int failed;
+} ByteWriter;
+
+typedef struct {
+    const unsigned char *data;
+    size_t size;
+    size_t offset;
+    int failed;
+} ByteReader;
+
+static void put_bytes(ByteWriter *writer, const void *value, size_t size) {
+    if (writer->failed || writer->size + size > writer->capacity) {
+        writer->failed = 1;
+        return;
+    }
+    memcpy(writer->data + writer->size, value, size);
+    writer->size += size;
+}
+
+static void get_bytes(ByteReader *reader, void *value, size_t size) {
+    if (reader->failed || reader->offset + size > reader->size) {
+        reader->failed = 1;
+        memset(value, 0, size);
+        return;
+    }
+    memcpy(value, reader->data + reader->offset, size);
+    reader->offset += size;
+}
+
+static void put_u8(ByteWriter *writer, int value) {
+    unsigned char byte = (unsigned char)value;
+
+    put_bytes(writer, &byte, 1);
+}
+
+static int get_u8(ByteReader *reader) {
+    unsigned char byte;
+
+    get_bytes(reader, &byte, 1);
+    return byte;
+}
+
+static void put_i8(ByteWriter *writer, int value) {
+    signed char byte = (signed char)value;
+
+    put_bytes(writer, &byte, 1);
+}
+
+static int get_i8(ByteReader *reader) {
+    signed char byte;
+
+    get_bytes(reader, &byte, 1);
+    return byte;
+}
+
+static void put_u32(ByteWriter *writer, int value) {
+    uint32_t word = (uint32_t)value;
+
+    put_bytes(writer, &word, sizeof(word));
+}
+
+static int get_u32(ByteReader *reader) {
+    uint32_t word;
+
+    get_bytes(reader, &word, sizeof(word));
+    return word > INT32_MAX ? -1 : (int)word;
+}
+
+static void put_reals(ByteWriter *writer, const sim_real *values, int count) {
+    put_bytes(writer, values, sizeof(sim_real) * (size_t)count);
+}
+
+static void get_reals(ByteReader *reader, sim_real *values, int count) {
+    get_bytes(reader, values, sizeof(sim_real) * (size_t)count);
+}
+
+/* Writes values[slots[0..count-1]] in order, i.e. one enemy field in dense order. */
+static void put_gathered(ByteWriter *writer, const sim_real *values, const int *slots, int count) {
+    size_t size = sizeof(sim_real) * (size_t)count;
+    int i;
+
+    if (writer->failed || writer->size + size > writer->capacity) {
+        writer->failed = 1;
+        return;
+    }
+    for (i = 0; i < count; ++i) {
+        memcpy(writer->data + writer->size, &values[slots[i]], sizeof(sim_real));
+        writer->size += sizeof(sim_real);
+    }
+}
+
+static void get_scattered(ByteReader *reader, sim_real *values, const int *slots, int count) {
+    size_t size = sizeof(sim_real) * (size_t)count;
+    int i;
+
+    if (reader->failed || reader->offset + size > reader->size) {
+        reader->failed = 1;
+        return;
+    }
+    for (i = 0; i < count; ++i) {
+        memcpy(&values[slots[i]], reader->data + reader->offset, sizeof(sim_real));
+        reader->offset += sizeof(sim_real);
+    }
+}
+
+size_t game_snapshot_max_size(const GameState *game) {
+    const GameLimits *limits = &game->limits;
+
+    return sizeof(GameLimits) + 1 + sizeof(Player) + sizeof(uint64_t) * 2 + sizeof(double) * 3 +
+           sizeof(int) * (7 + GAME_LOSS_COUNT) + 1 + MAX_HUMANS * (sizeof(sim_real) * 3 + 1) +
+           4 * 2 + (size_t)limits->max_enemies * (4 + sizeof(sim_real) * 3 + 3 + 4) +
+           4 + (size_t)limits->max_bullets * sizeof(sim_real) * 4 +
+           4 + (size_t)limits->max_enemy_bullets * sizeof(sim_real) * 5;
+}
+
+size_t game_snapshot_encode(const GameState *game, unsigned char *out, size_t capacity) {
+    const EntityPool *pool = &game->enemy_pool;
+    ByteWriter writer;
+    int free_count = 0;
+    int slot;
+    int i;
+
+    writer.data = out;
+    writer.size = 0;
+    writer.capacity = capacity;
+    writer.failed = 0;
+
+    put_bytes(&writer, &game->limits, sizeof(game->limits));
+    put_u8(&writer, sizeof(sim_real));
+    put_bytes(&writer, &game->player, sizeof(game->player));
+    put_bytes(&writer, &game->seed, sizeof(game->seed));
+    put_bytes(&writer, &game->rng_state, sizeof(game->rng_state));
+    put_bytes(&writer, &game->spawn_timer, sizeof(double));
+    put_bytes(&writer, &game->wave_clear_timer, sizeof(double));
+    put_bytes(&writer, &game->wave_banner_timer, sizeof(double));
+    put_bytes(&writer, &game->game_over, sizeof(int));
+    put_u8(&writer, game->loss_cause);
+    put_bytes(&writer, game->lives_lost, sizeof(game->lives_lost));
+    put_bytes(&writer, &game->wave_number, sizeof(int));
+    put_bytes(&writer, &game->wave_spawned, sizeof(int));
+    put_bytes(&writer, &game->wave_target, sizeof(int));
+    put_bytes(&writer, &game->wave_kills, sizeof(int));
+    put_bytes(&writer, &game->next_extra_life_score, sizeof(int));
+    put_bytes(&writer, &game->ai_tick, sizeof(unsigned));
+
+    for (i = 0; i < MAX_HUMANS; ++i) {
+        put_bytes(&writer, &game->humans[i].x, sizeof(sim_real));
+        put_bytes(&writer, &game->humans[i].y, sizeof(sim_real));
+        put_bytes(&writer, &game->humans[i].vy, sizeof(sim_real));
+        put_u8(&writer, game->humans[i].state);
+    }
+
+    for (slot = pool->free_head; slot >= 0; slot = pool->free_next[slot]) free_count++;
+    put_u32(&writer, pool->count);
+    put_u32(&writer, free_count);
+    for (i = 0; i < pool->count; ++i) put_u32(&writer, pool->dense[i]);
+    for (slot = pool->free_head; slot >= 0; slot = pool->free_next[slot]) put_u32(&writer, slot);
+
+    put_gathered(&writer, game->enemies.x, pool->dense, pool->count);
+    put_gathered(&writer, game->enemies.y, pool->dense, pool->count);
+    put_gathered(&writer, game->enemies.fire_timer, pool->dense, pool->count);
+    for (i = 0; i < pool->count; ++i) {
+        slot = pool->dense[i];
+        put_u8(&writer, game->enemies.type[slot]);
+        put_i8(&writer, game->enemies.carrying[slot]);
+        put_i8(&writer, game->enemies.dir[slot]);
+        put_bytes(&writer, &game->enemies.updated_tick[slot], sizeof(unsigned));
+    }
+
+    put_u32(&writer, game->bullets.count);
+    put_reals(&writer, game->bullets.x, game->bullets.count);
+    put_reals(&writer, game->bullets.y, game->bullets.count);
+    put_reals(&writer, game->bullets.vx, game->bullets.count);
+    put_reals(&writer, game->bullets.ttl, game->bullets.count);
+
+    put_u32(&writer, game->enemy_bullets.count);
+    put_reals(&writer, game->enemy_bullets.x, game->enemy_bullets.count);
+    put_reals(&writer, game->enemy_bullets.y, game->enemy_bullets.count);
+    put_reals(&writer, game->enemy_bullets.vx, game->enemy_bullets.count);
+    put_reals(&writer, game->enemy_bullets.vy, game->enemy_bullets.count);
+    put_reals(&writer, game->enemy_bullets.ttl, game->enemy_bullets.count);
+
+    return writer.failed ? 0 : writer.size;
+}
+
+static int decode_enemy_pool(ByteReader *reader, EntityPool *pool, int capacity) {
+    int count = get_u32(reader);
+    int free_count = get_u32(reader);
+    int previous = -1;
+    int i;
+
+    if (count < 0 || free_count < 0 || count + free_count != capacity) return 0;
+
+    pool->capacity = capacity;
+    pool->count = count;
+    pool->free_head = -1;
+    for (i = 0; i < capacity; ++i) {
+        pool->dense_pos[i] = -1;
+        pool->free_next[i] = -1;
+    }
+
+    for (i = 0; i < count; ++i) {
+        int slot = get_u32(reader);
+
+        if (slot < 0 || slot >= capacity || pool->dense_pos[slot] >= 0) return 0;
+        pool->dense[i] = slot;
+        pool->dense_pos[slot] = i;
+    }
+    /* Free slots are marked -2 while reading, so a repeated one cannot close a cycle. */
+    for (i = 0; i < free_count; ++i) {
+        int slot = get_u32(reader);
+
+        if (slot < 0 || slot >= capacity || pool->dense_pos[slot] != -1) return 0;
+        pool->dense_pos[slot] = -2;
+        if (previous < 0) pool->free_head = slot;
+        else pool->free_next[previous] = slot;
+        previous = slot;
+    }
+    for (i = pool->free_head; i >= 0; i = pool->free_next[i]) pool->dense_pos[i] = -1;
+    return !reader->failed;
+}
+
+/* -1 for nobody, else an index into GameState.humans. */
+static int valid_human_index(int index) {
+    return index >= -1 && index < MAX_HUMANS;
+}
+
+static int valid_x(double x) {
+    return x >= 0.0 && x < WORLD_W;
+}
+
+/* Everything stored is already wrapped; anything else (or a NaN) would stall game_wrap_x(). */
+static int valid_positions(const GameState *game) {
+    int i;
+
+    if (!valid_x(game->player.x)) return 0;
+    for (i = 0; i < MAX_HUMANS; ++i) {
+        if (!valid_x(game->humans[i].x)) return 0;
+    }
+    for (i = 0; i < game->enemy_pool.count; ++i) {
+        if (!valid_x(game->enemies.x[game->enemy_pool.dense[i]])) return 0;
+    }
+    for (i = 0; i < game->bullets.count; ++i) {
+        if (!valid_x(game->bullets.x[i])) return 0;
+    }
+    for (i = 0; i < game->enemy_bullets.count; ++i) {
+        if (!valid_x(game->enemy_bullets.x[i])) return 0;
+    }
+    return 1;
+}
+
+/* Clears `game` before validating; callers decode into scratch and copy on success. */
+static int decode_image(const unsigned char *image, size_t size, GameState *game) {
+    const EntityPool *pool = &game->enemy_pool;
+    ByteReader reader;
+    GameLimits limits;
+    int i;
+
+    reader.data = image;
+    reader.size = size;
+    reader.offset = 0;
+    reader.failed = 0;
+
+    get_bytes(&reader, &limits, sizeof(limits));
+    if (reader.failed || memcmp(&limits, &game->limits, sizeof(limits)) != 0) return 0;
+    if (get_u8(&reader) != sizeof(sim_real)) return 0;
+
+    game_clear(game);
+    get_bytes(&reader, &game->player, sizeof(game->player));
+    get_bytes(&reader, &game->seed, sizeof(game->seed));
+    get_bytes(&reader, &game->rng_state, sizeof(game->rng_state));
+    get_bytes(&reader, &game->spawn_timer, sizeof(double));
+    get_bytes(&reader, &game->wave_clear_timer, sizeof(double));
+    get_bytes(&reader, &game->wave_banner_timer, sizeof(double));
+    get_bytes(&reader, &game->game_over, sizeof(int));
+    game->loss_cause = (GameLoss)get_u8(&reader);
+    get_bytes(&reader, game->lives_lost, sizeof(game->lives_lost));
+    get_bytes(&reader, &game->wave_number, sizeof(int));
+    get_bytes(&reader, &game->wave_spawned, sizeof(int));
+    get_bytes(&reader, &game->wave_target, sizeof(int));
+    get_bytes(&reader, &game->wave_kills, sizeof(int));
+    get_bytes(&reader, &game->next_extra_life_score, sizeof(int));
+    get_bytes(&reader, &game->ai_tick, sizeof(unsigned));
+    if ((unsigned)game->loss_cause >= GAME_LOSS_COUNT || !valid_human_index(game->player.carrying_human)) return 0;
+
+    for (i = 0; i < MAX_HUMANS; ++i) {
+        int state;
+
+        get_bytes(&reader, &game->humans[i].x, sizeof(sim_real));
+        get_bytes(&reader, &game->humans[i].y, sizeof(sim_real));
+        get_bytes(&reader, &game->humans[i].vy, sizeof(sim_real));
+        state = get_u8(&reader);
+        if (state >= HUMAN_STATE_COUNT) return 0;
+        game->humans[i].state = (HumanState)state;
+    }
+
+    if (!decode_enemy_pool(&reader, &game->enemy_pool, limits.max_enemies)) return 0;
+
+    get_scattered(&reader, game->enemies.x, pool->dense, pool->count);
+    get_scattered(&reader, game->enemies.y, pool->dense, pool->count);
+    get_scattered(&reader, game->enemies.fire_timer, pool->dense, pool->count);
+    for (i = 0; i < pool->count; ++i) {
+        int slot = pool->dense[i];
+        int type = get_u8(&reader);
+
+        if (type > E_BOMBER) return 0;
+        game->enemies.type[slot] = (EnemyType)type;
+        game->enemies.carrying[slot] = get_i8(&reader);
+        game->enemies.dir[slot] = get_i8(&reader);
+        get_bytes(&reader, &game->enemies.updated_tick[slot], sizeof(unsigned));
+        if (!valid_human_index(game->enemies.carrying[slot])) return 0;
+        /* Between steps, no enemy can be more than a stride behind; a larger gap would
+         * hand its next update an unbounded dt. */
+        if (game->ai_tick - 1 - game->enemies.updated_tick[slot] >= GAME_AI_LOD_STRIDE) return 0;
+    }
+
+    game->bullets.count = get_u32(&reader);
+    if (game->bullets.count < 0 || game->bullets.count > game->bullets.capacity) return 0;
+    get_reals(&reader, game->bullets.x, game->bullets.count);
+    get_reals(&reader, game->bullets.y, game->bullets.count);
+    get_reals(&reader, game->bullets.vx, game->bullets.count);
+    get_reals(&reader, game->bullets.ttl, game->bullets.count);
+
+    game->enemy_bullets.count = get_u32(&reader);
+    if (game->enemy_bullets.count < 0 || game->enemy_bullets.count > game->enemy_bullets.capacity) return 0;
+    get_reals(&reader, game->enemy_bullets.x, game->enemy_bullets.count);
+    get_reals(&reader, game->enemy_bullets.y, game->enemy_bullets.count);
+    get_reals(&reader, game->enemy_bullets.vx, game->enemy_bullets.count);
+    get_reals(&reader, game->enemy_bullets.vy, game->enemy_bullets.count);
+    get_reals(&reader, game->enemy_bullets.ttl, game->enemy_bullets.count);
+
+    if (reader.failed || !valid_positions(game)) return 0;
+
+    game_rebuild_derived(game);
+    return 1;
+}
+
+static int decode_via(const unsigned char *image, size_t size, GameState *scratch, GameState *game) {
+    return decode_image(image, size, scratch) && game_copy(game, scratch);
+}
+
+int game_snapshot_decode(const unsigned char *image, size_t size, GameState *game) {
+    GameState scratch;
+    int ok;
+
+    if (!game_create(&scratch, &game->limits)) return 0;
+    ok = decode_via(image, size, &scratch, game);
+    game_destroy(&scratch);
+    return ok;
+}
+
+static size_t put_varint(unsigned char *out, size_t value) {
+    size_t size = 0;
+
+    while (value >= 0x80) {
+        out[size++] = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    out[size++] = (unsigned char)value;
+    return size;
+}
+
+/* Returns 0 if the varint is truncated or too long for a size_t. */
+static int get_varint(const unsigned char *in, size_t in_size, size_t *offset, size_t *value) {
+    int shift = 0;
+
+    *value = 0;
+    while (*offset < in_size && shift < (int)(sizeof(size_t) * 8)) {
+        unsigned char byte = in[(*offset)++];
+
+        *value |= (size_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return 1;
+        shift += 7;
+    }
+    return 0;
+}
+
+static uint64_t load_word(const unsigned char *bytes) {
+    uint64_t word;
+
+    memcpy(&word, bytes, sizeof(word));
+    return word;
+}
+
+/* Output is varint(size) then (equal words, literal words, literal XOR words) triples. Works
+ * on whole 8-byte words: the moving doubles dominate, so byte runs would buy little. */
+size_t snapshot_delta_max_size(size_t image_capacity) {
+    return image_capacity * 2 + 16;
+}
+
+size_t snapshot_delta_encode(const unsigned char *image, const unsigned char *base, size_t size,
+                             unsigned char *out) {
+    size_t out_size = put_varint(out, size);
+    size_t words = (size + 7) / 8;
+    size_t w = 0;
+
+    while (w < words) {
+        size_t run_start = w;
+        size_t literal_end;
+
+        while (w < words && load_word(image + w * 8) == load_word(base + w * 8)) w++;
+        literal_end = w;
+        while (literal_end < words && load_word(image + literal_end * 8) != load_word(base + literal_end * 8)) {
+            literal_end++;
+        }
+
+        out_size += put_varint(out + out_size, w - run_start);
+        out_size += put_varint(out + out_size, literal_end - w);
+        for (; w < literal_end; ++w) {
+            uint64_t word = load_word(image + w * 8) ^ load_word(base + w * 8);
+
+            memcpy(out + out_size, &word, sizeof(word));
+            out_size += sizeof(word);
+        }
+    }
+    return out_size;
+}
+
+size_t snapshot_delta_decode(const unsigned char *delta, size_t delta_size, const unsigned char *base,
+                             unsigned char *out, size_t capacity) {
+    size_t offset = 0;
+    size_t size;
+    size_t words;
+    size_t w = 0;
+
+    if (!get_varint(delta, delta_size, &offset, &size) || size == 0 || size > capacity) return 0;
+    words = (size + 7) / 8;
+    if (words * 8 > capacity) return 0;
+
+    memcpy(out, base, capacity);
+    while (w < words && offset < delta_size) {
+        size_t equal;
+        size_t literals;
+
+        if (!get_varint(delta, delta_size, &offset, &equal) ||
+            !get_varint(delta, delta_size, &offset, &literals)) {
+            return 0;
+        }
+        if (equal > words - w || literals > words - w - equal || literals > (delta_size - offset) / 8) {
+            return 0;
+        }
+        w += equal;
+        for (; literals > 0; --literals, ++w) {
+            uint64_t word = load_word(out + w * 8) ^ load_word(delta + offset);
+
+            memcpy(out + w * 8, &word, sizeof(word));
+            offset += sizeof(word);
+        }
+    }
+    memset(out + size, 0, capacity - size);
+    return size;
+}
+
+static SnapshotEntry *ring_entry(const SnapshotRing *ring, int n) {
+    return &ring->entries[(ring->first + n) % ring->capacity];
+}
+
+/* Drops the oldest keyframe and the deltas that depend on it. */
+static void ring_evict_group(SnapshotRing *ring) {
+    do {
+        ring->first = (ring->first + 1) % ring->capacity;
+        ring->count--;
+    } while (ring->count > 0 && !ring_entry(ring, 0)->keyframe);
+}
+
+static int ranges_overlap(size_t a, size_t a_size, size_t b, size_t b_size) {
+    return a < b + b_size && b < a + a_size;
+}
+
+int snapshot_ring_init(SnapshotRing *ring, const GameState *game, int capacity, int keyframe_interval,
+                       size_t arena_size) {
+    memset(ring, 0, sizeof(*ring));
+    ring->capacity = capacity;
+    ring->keyframe_interval = keyframe_interval > 0 ? keyframe_interval : 1;
+    ring->image_capacity = (game_snapshot_max_size(game) + 7) & ~(size_t)7;
+    ring->arena_size = arena_size;
+
+    ring->arena = malloc(arena_size);
+    ring->entries = calloc((size_t)capacity, sizeof(*ring->entries));
+    ring->last_image = calloc(1, ring->image_capacity);
+    ring->work_image = calloc(1, ring->image_capacity);
+    ring->base_image = calloc(1, ring->image_capacity);
+    ring->delta = malloc(snapshot_delta_max_size(ring->image_capacity));
+    if (capacity <= 0 || !ring->arena || !ring->entries || !ring->last_image ||
+        !ring->work_image || !ring->base_image || !ring->delta ||
+        !game_create(&ring->scratch, &game->limits)) {
+        snapshot_ring_free(ring);
+        return 0;
+    }
+    return 1;
+}
+
+void snapshot_ring_clear(SnapshotRing *ring) {
+    ring->write_offset = 0;
+    ring->first = 0;
+    ring->count = 0;
+    ring->since_keyframe = 0;
+    ring->last_size = 0;
+}
+
+void snapshot_ring_free(SnapshotRing *ring) {
+    free(ring->arena);
+    free(ring->entries);
+    free(ring->last_image);
+    free(ring->work_image);
+    free(ring->base_image);
+    free(ring->delta);
+    game_destroy(&ring->scratch);
+    memset(ring, 0, sizeof(*ring));
+}
+
+int snapshot_ring_push(SnapshotRing *ring, const GameState *game, long step) {
+    size_t image_size = game_snapshot_encode(game, ring->work_image, ring->image_capacity);
+    int keyframe = ring->count == 0 || ring->since_keyframe + 1 >= ring->keyframe_interval;
+    const unsigned char *stored;
+    size_t stored_size;
+    size_t offset;
+    SnapshotEntry *entry;
+    unsigned char *swap;
+
+    if (image_size == 0) return 0;
+    if (ring->count > 0 && step <= snapshot_ring_newest_step(ring)) return 0;
+    memset(ring->work_image + image_size, 0, ring->image_capacity - image_size);
+
+    /* Keyframes are stored as the plain image; everything else as a delta on the last one. */
+    if (!keyframe) {
+        stored_size = snapshot_delta_encode(ring->work_image, ring->last_image, image_size, ring->delta);
+        keyframe = stored_size >= image_size;
+    }
+    stored = keyframe ? ring->work_image : ring->delta;
+    stored_size = keyframe ? image_size : stored_size;
+    if (image_size > ring->arena_size) return 0;
+
+    offset = ring->write_offset;
+    if (offset + stored_size > ring->arena_size) {
+        /* Wrapping: everything still stored past the write point is the oldest data. */
+        while (ring->count > 0 && ring_entry(ring, 0)->offset >= offset) ring_evict_group(ring);
+        offset = 0;
+    }
+
+    while (ring->count > 0 &&
+           (ring->count == ring->capacity ||
+            ranges_overlap(offset, stored_size, ring_entry(ring, 0)->offset, ring_entry(ring, 0)->size))) {
+        ring_evict_group(ring);
+    }
+    if (ring->count == 0 && !keyframe) {
+        keyframe = 1;
+        stored = ring->work_image;
+        stored_size = image_size;
+        offset = 0;
+    }
+
+    memcpy(ring->arena + offset, stored, stored_size);
+    entry = ring_entry(ring, ring->count);
+    entry->step = step;
+    entry->offset = offset;
+    entry->size = stored_size;
+    entry->keyframe = keyframe;
+    ring->count++;
+    ring->write_offset = offset + stored_size;
+    ring->since_keyframe = keyframe ? 0 : ring->since_keyframe + 1;
+
+    swap = ring->last_image;
+    ring->last_image = ring->work_image;
+    ring->work_image = swap;
+    ring->last_size = image_size;
+    return 1;
+}
+
+static int ring_find(const SnapshotRing *ring, long step) {
+    int lo = 0;
+    int hi = ring->count - 1;
+
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        long mid_step = ring_entry(ring, mid)->step;
+
+        if (mid_step == step) return mid;
+        if (mid_step < step) lo = mid + 1;
+        else hi = mid - 1;
+    }
+    return -1;
+}
+
+/* Rebuilds entry n's image into ring->work_image, zero-padded, and returns its size. */
+static size_t ring_build_image(SnapshotRing *ring, int n) {
+    const SnapshotEntry *entry;
+    int start = n;
+    size_t size;
+    int k;
+
+    while (start > 0 && !ring_entry(ring, start)->keyframe) start--;
+
+    entry = ring_entry(ring, start);
+    size = entry->size;
+    memcpy(ring->work_image, ring->arena + entry->offset, size);
+    memset(ring->work_image + size, 0, ring->image_capacity - size);
+
+    for (k = start + 1; k <= n; ++k) {
+        unsigned char *swap = ring->base_image;
+
+        ring->base_image = ring->work_image;
+        ring->work_image = swap;
+
+        entry = ring_entry(ring, k);
+        size = snapshot_delta_decode(ring->arena + entry->offset, entry->size, ring->base_image,
+                            ring->work_image, ring->image_capacity);
+        if (size == 0) return 0;
+    }
+    return size;
+}
+
+int snapshot_ring_restore(SnapshotRing *ring, long step, GameState *game) {
+    int n = ring_find(ring, step);
+    size_t size;
+
+    if (n < 0) return 0;
+
+    size = ring_build_image(ring, n);
+    return size > 0 && decode_via(ring->work_image, size, &ring->scratch, game);
+}
+
+int snapshot_ring_rollback(SnapshotRing *ring, long step, GameState *game) {
+    int n = ring_find(ring, step);
+    size_t size;
+    const SnapshotEntry *entry;
+    unsigned char *swap;
+    int k;
+
+    if (n < 0) return 0;
+
+    size = ring_build_image(ring, n);
+    if (size == 0 || !decode_via(ring->work_image, size, &ring->scratch, game)) return 0;
+
+    swap = ring->last_image;
+    ring->last_image = ring->work_image;
+    ring->work_image = swap;
+    ring->last_size = size;
+    ring->count = n + 1;
+
+    entry = ring_entry(ring, n);
+    ring->write_offset = entry->offset + entry->size;
+    ring->since_keyframe = 0;
+    for (k = n; k > 0 && !ring_entry(ring, k)->keyframe; --k) ring->since_keyframe++;
+    return 1;
+}
+
+long snapshot_ring_oldest_step(const SnapshotRing *ring) {
+    return ring->count > 0 ? ring_entry(ring, 0)->step : -1;
+}
+
+long snapshot_ring_newest_step(const SnapshotRing *ring) {
+    return ring->count > 0 ? ring_entry(ring, ring->count - 1)->step : -1;
+}
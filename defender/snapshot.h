@@ -0,0 +1,72 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "game.h"
+
+#include <stddef.h>
+
+/* Compact image of a GameState: scalars, humans and only the live enemies and shots,
+ * plus the enemy pool's slot order so a restored game spawns and iterates exactly as
+ * the original would. Derived data (the collision grid, terrain) is rebuilt on decode, which
+ * needs a game created with the limits the image was taken with, in a build with the same
+ * sim_real (float and double builds reject each other's images). */
+/* Upper bound on the encoded size for games created with the same limits as `game`. */
+size_t game_snapshot_max_size(const GameState *game);
+size_t game_snapshot_encode(const GameState *game, unsigned char *out, size_t capacity);
+/* Returns 0 and leaves `game` unchanged if the image is malformed or was taken with other limits. */
+int game_snapshot_decode(const unsigned char *image, size_t size, GameState *game);
+
+/* Delta coding between two images of the same game, as SnapshotRing stores them. Image
+ * buffers must be zero-padded up to a multiple of 8 bytes. */
+size_t snapshot_delta_max_size(size_t image_capacity);
+size_t snapshot_delta_encode(const unsigned char *image, const unsigned char *base, size_t size,
+                             unsigned char *out);
+/* Rebuilds the image into out (capacity bytes, zero-padded past the image); returns its size,
+ * or 0 if the delta is malformed. */
+size_t snapshot_delta_decode(const unsigned char *delta, size_t delta_size, const unsigned char *base,
+                             unsigned char *out, size_t capacity);
+
+typedef struct {
+    long step;
+    size_t offset;
+    size_t size;
+    int keyframe;
+} SnapshotEntry;
+
+/* Last N steps of snapshots in one preallocated arena. Each entry is the XOR of its image
+ * with the previous entry's image, run-length coded in 8-byte words; every keyframe_interval
+ * entries a plain image is stored instead, so a restore decodes at most that many deltas. */
+typedef struct {
+    unsigned char *arena;
+    size_t arena_size;
+    size_t write_offset;
+    SnapshotEntry *entries;
+    int capacity;
+    int first;
+    int count;
+    int keyframe_interval;
+    int since_keyframe;
+    size_t image_capacity;
+    unsigned char *last_image;
+    size_t last_size;
+    unsigned char *work_image;
+    unsigned char *base_image;
+    unsigned char *delta;
+    /* Restores decode here first, so a bad image never clobbers the caller's game. */
+    GameState scratch;
+} SnapshotRing;
+
+/* Sized for games created with the same limits as `game`. */
+int snapshot_ring_init(SnapshotRing *ring, const GameState *game, int capacity, int keyframe_interval,
+                       size_t arena_size);
+void snapshot_ring_clear(SnapshotRing *ring);
+void snapshot_ring_free(SnapshotRing *ring);
+/* Stores the state at `step`; steps must increase. Old entries are evicted as needed. */
+int snapshot_ring_push(SnapshotRing *ring, const GameState *game, long step);
+int snapshot_ring_restore(SnapshotRing *ring, long step, GameState *game);
+/* Restores `step` and forgets everything newer, so re-simulation can push from there. */
+int snapshot_ring_rollback(SnapshotRing *ring, long step, GameState *game);
+long snapshot_ring_oldest_step(const SnapshotRing *ring);
+long snapshot_ring_newest_step(const SnapshotRing *ring);
+
+#endif
@@ -0,0 +1,507 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "spectate.h"
+#include "snapshot.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define SPECTATE_MAGIC "DFSP"
+#define SPECTATE_VERSION 3
+#define SPECTATE_FRESH 4
+#define SPECTATE_INDEX_MASK 3
+
+/* Sent once to every client before any record. */
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t real_size;
+    GameLimits limits;
+} SpectateHello;
+
+/* Precedes every record, in the ring and on the wire. The payload is a snapshot image for
+ * keyframes and a snapshot_delta_encode() delta on the previous record otherwise. */
+typedef struct {
+    uint32_t size;
+    uint32_t keyframe;
+    int64_t step;
+} SpectateRecord;
+
+static int set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL);
+
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+static int socket_address(struct sockaddr_un *address, const char *path) {
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address->sun_path)) return 0;
+    strcpy(address->sun_path, path);
+    return 1;
+}
+
+static void ring_write(SpectateServer *server, uint64_t offset, const void *bytes, size_t size) {
+    size_t start = (size_t)(offset & (server->ring_size - 1));
+    size_t first = size < server->ring_size - start ? size : server->ring_size - start;
+
+    memcpy(server->ring + start, bytes, first);
+    memcpy(server->ring, (const unsigned char *)bytes + first, size - first);
+}
+
+static void ring_read(const SpectateServer *server, uint64_t offset, void *bytes, size_t size) {
+    size_t start = (size_t)(offset & (server->ring_size - 1));
+    size_t first = size < server->ring_size - start ? size : server->ring_size - start;
+
+    memcpy(bytes, server->ring + start, first);
+    memcpy((unsigned char *)bytes + first, server->ring, size - first);
+}
+
+/* Encodes the frame as the next record, evicting the oldest records to make room. */
+static void append_record(SpectateServer *server, const GameState *game, long step) {
+    size_t size = game_snapshot_encode(game, server->image, server->image_capacity);
+    int keyframe = !server->have_keyframe || server->since_keyframe + 1 >= SPECTATE_KEYFRAME_INTERVAL;
+    const unsigned char *payload = server->image;
+    SpectateRecord record;
+    unsigned char *swap;
+    int c;
+
+    if (size == 0) return;
+    memset(server->image + size, 0, server->image_capacity - size);
+    record.size = (uint32_t)size;
+    if (!keyframe) {
+        size_t delta_size = snapshot_delta_encode(server->image, server->last_image, size, server->delta);
+
+        if (delta_size < size) {
+            payload = server->delta;
+            record.size = (uint32_t)delta_size;
+        } else {
+            keyframe = 1;
+        }
+    }
+    record.keyframe = (uint32_t)keyframe;
+    record.step = step;
+
+    while (server->head + sizeof(record) + record.size - server->tail > server->ring_size) {
+        SpectateRecord oldest;
+
+        ring_read(server, server->tail, &oldest, sizeof(oldest));
+        server->tail += sizeof(oldest) + oldest.size;
+    }
+    ring_write(server, server->head, &record, sizeof(record));
+    ring_write(server, server->head + sizeof(record), payload, record.size);
+
+    if (keyframe) {
+        server->keyframe_at = server->head;
+        server->have_keyframe = 1;
+        server->since_keyframe = 0;
+        server->keyframes++;
+        for (c = 0; c < server->client_count; ++c) {
+            if (server->clients[c].waiting) {
+                server->clients[c].cursor = server->head;
+                server->clients[c].waiting = 0;
+            }
+        }
+    } else {
+        server->since_keyframe++;
+    }
+    server->head += sizeof(record) + record.size;
+    server->records++;
+    server->record_bytes += (long long)(sizeof(record) + record.size);
+    /* A run of large deltas pushed the last keyframe out; make the next record one. */
+    if (server->keyframe_at < server->tail) server->have_keyframe = 0;
+
+    swap = server->last_image;
+    server->last_image = server->image;
+    server->image = swap;
+}
+
+static int reserve_out(SpectateClient *client, size_t size) {
+    unsigned char *grown;
+
+    if (size <= client->out_capacity) return 1;
+    grown = realloc(client->out, size);
+    if (!grown) return 0;
+    client->out = grown;
+    client->out_capacity = size;
+    return 1;
+}
+
+/* Once everything copied for the client has been sent, copies the next whole records. */
+static int fill_client(SpectateServer *server, SpectateClient *client) {
+    if (client->out_sent < client->out_size) return 1;
+    client->out_size = 0;
+    client->out_sent = 0;
+    if (client->waiting) return 1;
+
+    if (client->cursor < server->tail) {
+        server->resyncs++;
+        if (!server->have_keyframe) {
+            client->waiting = 1;
+            return 1;
+        }
+        client->cursor = server->keyframe_at;
+    }
+
+    while (client->cursor < server->head) {
+        SpectateRecord record;
+        size_t record_size;
+
+        ring_read(server, client->cursor, &record, sizeof(record));
+        record_size = sizeof(record) + record.size;
+        if (client->out_size > 0 && client->out_size + record_size > SPECTATE_SEND_CHUNK) break;
+        if (!reserve_out(client, client->out_size + record_size)) return 0;
+        ring_read(server, client->cursor, client->out + client->out_size, record_size);
+        client->out_size += record_size;
+        client->cursor += record_size;
+    }
+    return 1;
+}
+
+/* Sends until the socket would block; 0 if the client is gone. */
+static int send_client(SpectateServer *server, SpectateClient *client) {
+    while (1) {
+        ssize_t sent;
+
+        if (!fill_client(server, client)) return 0;
+        if (client->out_sent == client->out_size) return 1;
+        sent = send(client->fd, client->out + client->out_sent, client->out_size - client->out_sent, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        client->out_sent += (size_t)sent;
+    }
+}
+
+static void drop_client(SpectateServer *server, int c) {
+    close(server->clients[c].fd);
+    free(server->clients[c].out);
+    server->clients[c] = server->clients[--server->client_count];
+    atomic_fetch_sub_explicit(&server->clients_connected, 1, memory_order_release);
+}
+
+static void accept_clients(SpectateServer *server) {
+    while (1) {
+        SpectateClient *client;
+        SpectateHello hello;
+        int fd = accept(server->listen_fd, NULL, NULL);
+
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        if (server->client_count == SPECTATE_MAX_CLIENTS || !set_nonblocking(fd)) {
+            close(fd);
+            continue;
+        }
+
+        client = &server->clients[server->client_count];
+        memset(client, 0, sizeof(*client));
+        client->fd = fd;
+        memset(&hello, 0, sizeof(hello));
+        memcpy(hello.magic, SPECTATE_MAGIC, sizeof(hello.magic));
+        hello.version = SPECTATE_VERSION;
+        hello.real_size = (uint32_t)sizeof(sim_real);
+        hello.limits = server->limits;
+        if (!reserve_out(client, sizeof(hello))) {
+            close(fd);
+            continue;
+        }
+        memcpy(client->out, &hello, sizeof(hello));
+        client->out_size = sizeof(hello);
+        /* New viewers start at the newest keyframe, or wait for the next one. */
+        client->cursor = server->keyframe_at;
+        client->waiting = !server->have_keyframe;
+        server->client_count++;
+        server->clients_seen++;
+        atomic_fetch_add_explicit(&server->clients_connected, 1, memory_order_release);
+    }
+}
+
+static void *broadcaster_main(void *arg) {
+    SpectateServer *server = arg;
+    struct pollfd fds[2 + SPECTATE_MAX_CLIENTS];
+
+    while (atomic_load_explicit(&server->running, memory_order_acquire)) {
+        int polled = server->client_count;
+        int c;
+
+        fds[0].fd = server->listen_fd;
+        fds[0].events = POLLIN;
+        fds[1].fd = server->wake[0];
+        fds[1].events = POLLIN;
+        for (c = 0; c < server->client_count; ++c) {
+            const SpectateClient *client = &server->clients[c];
+
+            fds[2 + c].fd = client->fd;
+            fds[2 + c].events = client->out_sent < client->out_size ? POLLOUT : 0;
+        }
+        /* A signal leaves revents unset; level-triggered, the next poll() reports it all again. */
+        if (poll(fds, (nfds_t)(2 + polled), -1) < 0) {
+            if (errno != EINTR) break;
+            continue;
+        }
+
+        if (fds[1].revents) {
+            char drain[64];
+
+            while (read(server->wake[0], drain, sizeof(drain)) > 0) {
+            }
+        }
+        if (fds[0].revents) accept_clients(server);
+
+        if (atomic_load_explicit(&server->shared, memory_order_acquire) & SPECTATE_FRESH) {
+            SpectateFrame *frame;
+
+            server->front = atomic_exchange_explicit(&server->shared, server->front, memory_order_acq_rel) &
+                            SPECTATE_INDEX_MASK;
+            frame = &server->frames[server->front];
+            append_record(server, &frame->game, frame->step);
+        }
+
+        /* Backwards, so dropping a client (which moves the last one into its place) only
+         * touches entries already visited. Clients accepted this round have no pollfd yet. */
+        for (c = server->client_count - 1; c >= 0; --c) {
+            short revents = c < polled ? fds[2 + c].revents : 0;
+
+            if ((revents & (POLLERR | POLLHUP | POLLNVAL)) || !send_client(server, &server->clients[c])) {
+                drop_client(server, c);
+            }
+        }
+    }
+    return NULL;
+}
+
+int spectate_server_start(SpectateServer *server, const char *path, const GameLimits *limits) {
+    struct sockaddr_un address;
+    struct stat info;
+    size_t ring_size = SPECTATE_MIN_RING_SIZE;
+    int i;
+
+    memset(server, 0, sizeof(*server));
+    server->listen_fd = -1;
+    server->wake[0] = server->wake[1] = -1;
+    atomic_init(&server->shared, 2);
+    atomic_init(&server->clients_connected, 0);
+    atomic_init(&server->running, 0);
+    server->back = 0;
+    server->front = 1;
+    if (!socket_address(&address, path)) return 0;
+    strcpy(server->path, path);
+    server->limits = *limits;
+
+    for (i = 0; i < 3; ++i) {
+        if (!game_create(&server->frames[i].game, limits)) {
+            spectate_server_stop(server);
+            return 0;
+        }
+    }
+    server->image_capacity = (game_snapshot_max_size(&server->frames[0].game) + 7) & ~(size_t)7;
+    while (ring_size < 8 * (server->image_capacity + sizeof(SpectateRecord))) ring_size *= 2;
+    server->ring_size = ring_size;
+    server->ring = malloc(ring_size);
+    server->image = calloc(1, server->image_capacity);
+    server->last_image = calloc(1, server->image_capacity);
+    server->delta = malloc(snapshot_delta_max_size(server->image_capacity));
+    if (!server->ring || !server->image || !server->last_image || !server->delta) {
+        spectate_server_stop(server);
+        return 0;
+    }
+
+    /* Only a leftover socket is replaced, never some other file. */
+    if (lstat(path, &info) == 0 && S_ISSOCK(info.st_mode)) unlink(path);
+    server->listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server->listen_fd < 0 || !set_nonblocking(server->listen_fd) ||
+        bind(server->listen_fd, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+        listen(server->listen_fd, SPECTATE_MAX_CLIENTS) != 0 || pipe(server->wake) != 0 ||
+        !set_nonblocking(server->wake[0]) || !set_nonblocking(server->wake[1])) {
+        spectate_server_stop(server);
+        return 0;
+    }
+
+    atomic_store_explicit(&server->running, 1, memory_order_release);
+    if (pthread_create(&server->thread, NULL, broadcaster_main, server) != 0) {
+        atomic_store_explicit(&server->running, 0, memory_order_release);
+        spectate_server_stop(server);
+        return 0;
+    }
+    return 1;
+}
+
+static void wake_broadcaster(SpectateServer *server) {
+    char byte = 0;
+    /* A full pipe already holds a wake-up. */
+    ssize_t ignored = write(server->wake[1], &byte, 1);
+
+    (void)ignored;
+}
+
+void spectate_offer(SpectateServer *server, const GameState *game, long step) {
+    SpectateFrame *frame;
+
+    if (atomic_load_explicit(&server->clients_connected, memory_order_acquire) == 0) return;
+
+    frame = &server->frames[server->back];
+    game_copy(&frame->game, game);
+    frame->step = step;
+    server->back = atomic_exchange_explicit(&server->shared, server->back | SPECTATE_FRESH, memory_order_acq_rel) &
+                   SPECTATE_INDEX_MASK;
+    wake_broadcaster(server);
+}
+
+void spectate_server_stop(SpectateServer *server) {
+    int i;
+
+    if (atomic_load_explicit(&server->running, memory_order_acquire)) {
+        atomic_store_explicit(&server->running, 0, memory_order_release);
+        wake_broadcaster(server);
+        pthread_join(server->thread, NULL);
+    }
+    while (server->client_count > 0) drop_client(server, server->client_count - 1);
+    if (server->listen_fd >= 0) {
+        close(server->listen_fd);
+        unlink(server->path);
+    }
+    if (server->wake[0] >= 0) close(server->wake[0]);
+    if (server->wake[1] >= 0) close(server->wake[1]);
+    server->listen_fd = -1;
+    server->wake[0] = server->wake[1] = -1;
+    for (i = 0; i < 3; ++i) game_destroy(&server->frames[i].game);
+    free(server->ring);
+    free(server->image);
+    free(server->last_image);
+    free(server->delta);
+    server->ring = server->image = server->last_image = server->delta = NULL;
+}
+
+void spectate_print_stats(const SpectateServer *server, FILE *file) {
+    if (server->clients_seen == 0) return;
+    fprintf(file, "spectators: %ld connected, %ld records (%ld keyframes), %.0f bytes/record, %ld resyncs\n",
+            server->clients_seen, server->records, server->keyframes,
+            server->records > 0 ? (double)server->record_bytes / server->records : 0.0, server->resyncs);
+}
+
+int spectate_viewer_open(SpectateViewer *viewer, const char *path) {
+    struct sockaddr_un address;
+
+    memset(viewer, 0, sizeof(*viewer));
+    viewer->fd = -1;
+    if (!socket_address(&address, path)) return 0;
+    viewer->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (viewer->fd < 0 || connect(viewer->fd, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+        !set_nonblocking(viewer->fd)) {
+        spectate_viewer_close(viewer);
+        return 0;
+    }
+    return 1;
+}
+
+static int viewer_start(SpectateViewer *viewer, const SpectateHello *hello) {
+    if (memcmp(hello->magic, SPECTATE_MAGIC, sizeof(hello->magic)) != 0 || hello->version != SPECTATE_VERSION ||
+        hello->real_size != sizeof(sim_real) || !game_create(&viewer->game, &hello->limits)) {
+        return 0;
+    }
+    viewer->have_game = 1;
+    /* Builds the terrain, which snapshots don't carry. */
+    game_init(&viewer->game, 0);
+    viewer->image_capacity = (game_snapshot_max_size(&viewer->game) + 7) & ~(size_t)7;
+    viewer->image = calloc(1, viewer->image_capacity);
+    viewer->scratch = calloc(1, viewer->image_capacity);
+    return viewer->image && viewer->scratch;
+}
+
+static int viewer_apply(SpectateViewer *viewer, const SpectateRecord *record, const unsigned char *payload) {
+    unsigned char *swap;
+
+    if (record->keyframe) {
+        if (record->size > viewer->image_capacity) return 0;
+        memcpy(viewer->image, payload, record->size);
+        memset(viewer->image + record->size, 0, viewer->image_capacity - record->size);
+        viewer->image_size = record->size;
+        viewer->keyframes++;
+    } else {
+        /* Deltas before the first keyframe have no base; skip them. */
+        if (viewer->image_size == 0) return 1;
+        viewer->image_size = snapshot_delta_decode(payload, record->size, viewer->image, viewer->scratch,
+                                                   viewer->image_capacity);
+        if (viewer->image_size == 0) return 0;
+        swap = viewer->image;
+        viewer->image = viewer->scratch;
+        viewer->scratch = swap;
+    }
+    viewer->step = (long)record->step;
+    viewer->records++;
+    return 1;
+}
+
+int spectate_viewer_poll(SpectateViewer *viewer) {
+    size_t offset = 0;
+    long records = viewer->records;
+    int ended = 0;
+
+    while (1) {
+        ssize_t got;
+
+        if (viewer->in_capacity - viewer->in_size < 4096) {
+            size_t capacity = viewer->in_capacity ? viewer->in_capacity * 2 : 65536;
+            unsigned char *grown = realloc(viewer->in, capacity);
+
+            if (!grown) return -1;
+            viewer->in = grown;
+            viewer->in_capacity = capacity;
+        }
+        got = read(viewer->fd, viewer->in + viewer->in_size, viewer->in_capacity - viewer->in_size);
+        if (got > 0) {
+            viewer->in_size += (size_t)got;
+            continue;
+        }
+        if (got < 0 && errno == EINTR) continue;
+        ended = got == 0 || (errno != EAGAIN && errno != EWOULDBLOCK);
+        break;
+    }
+
+    if (!viewer->have_game) {
+        SpectateHello hello;
+
+        if (viewer->in_size < sizeof(hello)) return ended ? -1 : 0;
+        memcpy(&hello, viewer->in, sizeof(hello));
+        if (!viewer_start(viewer, &hello)) return -1;
+        offset = sizeof(hello);
+    }
+
+    while (viewer->in_size - offset >= sizeof(SpectateRecord)) {
+        SpectateRecord record;
+
+        memcpy(&record, viewer->in + offset, sizeof(record));
+        if (viewer->in_size - offset - sizeof(record) < record.size) break;
+        if (!viewer_apply(viewer, &record, viewer->in + offset + sizeof(record))) return -1;
+        offset += sizeof(record) + record.size;
+    }
+    memmove(viewer->in, viewer->in + offset, viewer->in_size - offset);
+    viewer->in_size -= offset;
+
+    /* Only the newest image is worth decoding into the game. */
+    if (viewer->records != records && viewer->image_size > 0) {
+        if (!game_snapshot_decode(viewer->image, viewer->image_size, &viewer->game)) return -1;
+        return 1;
+    }
+    return ended ? -1 : 0;
+}
+
+void spectate_viewer_close(SpectateViewer *viewer) {
+    if (viewer->fd >= 0) close(viewer->fd);
+    if (viewer->have_game) game_destroy(&viewer->game);
+    free(viewer->in);
+    free(viewer->image);
+    free(viewer->scratch);
+    memset(viewer, 0, sizeof(*viewer));
+    viewer->fd = -1;
+}
@@ -0,0 +1,110 @@
+#ifndef SPECTATE_H
+#define SPECTATE_H
+
+#include "game.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define SPECTATE_MAX_CLIENTS 16
+/* Records between keyframes; a client that fell behind rejoins at the newest one. */
+#define SPECTATE_KEYFRAME_INTERVAL 60
+/* The ring is at least this big, and room for several keyframes at the game's limits. */
+#define SPECTATE_MIN_RING_SIZE ((size_t)1 << 20)
+/* Most bytes copied out of the ring for one client at a time. */
+#define SPECTATE_SEND_CHUNK ((size_t)64 << 10)
+
+typedef struct {
+    int fd;
+    /* Ring offset of the next record to send, unless waiting for a keyframe. */
+    uint64_t cursor;
+    int waiting;
+    /* Records copied out of the ring, so it can be overwritten while they are sent. */
+    unsigned char *out;
+    size_t out_size;
+    size_t out_sent;
+    size_t out_capacity;
+} SpectateClient;
+
+typedef struct {
+    GameState game;
+    long step;
+} SpectateFrame;
+
+/* Streams the game to `defender --spectate` clients over a Unix domain socket. The render
+ * loop offers each frame through a triple buffer and never waits. A broadcaster thread
+ * encodes the frames as snapshot deltas into one byte ring, and every client sends from
+ * its own cursor into it. A client that falls a full ring behind skips ahead to the
+ * newest keyframe. */
+typedef struct {
+    char path[108];
+    int listen_fd;
+    int wake[2];
+    /* Set before the broadcaster starts and read-only after, unlike the frames it describes. */
+    GameLimits limits;
+
+    SpectateFrame frames[3];
+    int back;
+    int front;
+    atomic_int shared;
+    atomic_int clients_connected;
+
+    /* Everything below belongs to the broadcaster thread. */
+    unsigned char *ring;
+    size_t ring_size;
+    uint64_t head;
+    uint64_t tail;
+    uint64_t keyframe_at;
+    int have_keyframe;
+    int since_keyframe;
+    size_t image_capacity;
+    unsigned char *image;
+    unsigned char *last_image;
+    unsigned char *delta;
+    SpectateClient clients[SPECTATE_MAX_CLIENTS];
+    int client_count;
+
+    long records;
+    long keyframes;
+    long long record_bytes;
+    long resyncs;
+    long clients_seen;
+
+    atomic_int running;
+    pthread_t thread;
+} SpectateServer;
+
+/* Listens on path (replacing a stale socket there) for games created with limits. */
+int spectate_server_start(SpectateServer *server, const char *path, const GameLimits *limits);
+/* Render loop: hands over the state after step. Costs nothing while nobody is watching. */
+void spectate_offer(SpectateServer *server, const GameState *game, long step);
+void spectate_server_stop(SpectateServer *server);
+void spectate_print_stats(const SpectateServer *server, FILE *file);
+
+/* Client end of the stream: keeps the latest game state decoded. */
+typedef struct {
+    int fd;
+    int have_game;
+    GameState game;
+    long step;
+    unsigned char *in;
+    size_t in_size;
+    size_t in_capacity;
+    size_t image_capacity;
+    size_t image_size;
+    unsigned char *image;
+    unsigned char *scratch;
+    long records;
+    long keyframes;
+} SpectateViewer;
+
+int spectate_viewer_open(SpectateViewer *viewer, const char *path);
+/* Reads what has arrived without blocking. Returns 1 if viewer->game moved on, 0 if not,
+ * and -1 once the stream has ended or turned out malformed. */
+int spectate_viewer_poll(SpectateViewer *viewer);
+void spectate_viewer_close(SpectateViewer *viewer);
+
+#endif